@@ -0,0 +1,271 @@
+/*
+ * File: bench1.c
+ * Author: Sofia Pinho
+ * Description: A benchmark for the task management system of proj1. It
+ * generates command streams with a growing number of tasks, runs them through
+ * the commands of proj1 and reports the throughput and a latency histogram
+ * of each command for every number of tasks.
+ *
+ * Build: gcc -O2 -Wall -Wextra -ansi -pedantic -o bench1 bench1.c
+ * Usage: bench1 [-t max_tasks] [-b budget_seconds] [-s seed]
+ * The number of tasks grows tenfold from 1000 up to max_tasks, a run that
+ * takes longer than the budget is stopped and no bigger one is tried.
+*/
+
+#define _XOPEN_SOURCE 600
+
+#define MAX_TASK 10000000 /*the benchmark scales up to 10^7 tasks*/
+#define main proj1_main
+#include "proj1.c"
+#undef main
+
+#include <time.h>
+#include <unistd.h>
+
+#define COMMANDS      "tlnumdawrosh" /*commands measured*/
+#define NUM_COMMANDS  12
+#define NUM_BUCKETS   32 /*latency histogram buckets, bucket i holds latencies below 2^i us*/
+#define MIN_TASKS     1000
+#define BUDGET        10
+#define SEED          1
+#define NUM_USERS     20
+#define MAX_BURST     16 /*max tasks created in a row*/
+#define MAX_MOVES     8 /*max moves after each burst*/
+#define MAX_ADVANCE   5 /*max time advanced after each burst*/
+#define NUM_POLLS     20 /*number of l, d, w, r, o, s and h queries in each run*/
+
+/*activities the tasks are moved to, besides the default ones*/
+const char *extra_activities[] = {"REVIEW", "QA"};
+const char *move_activities[] = {IN_P_DESC, "REVIEW", "QA", DONE_DESC};
+
+/*type used to store the latencies measured for one command*/
+typedef struct
+{
+    int count;
+    int buckets[NUM_BUCKETS];
+    double total, max;
+} command_stats;
+
+/*returns the next number of the pseudo random sequence that starts at
+seed, the same on every platform so that runs are reproducible*/
+unsigned long next_random(unsigned long *seed)
+{
+    *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+    return *seed >> 8;
+}
+
+/*returns a different number for each n, scattered so that tasks
+aren't created in alphabetical order*/
+unsigned long scramble(unsigned long n)
+{
+    n = (n * 2654435761UL) & 0xffffffffUL;
+    return n ^ (n >> 16);
+}
+
+/*writes a command stream that creates num_tasks tasks in bursts, with moves
+and time advances between them and l, d, w, r, o, s and h queries polled NUM_POLLS times*/
+void write_workload(FILE *out, int num_tasks, unsigned long seed)
+{
+    int i, j, created = 0, poll_every = num_tasks / NUM_POLLS;
+    int burst, next_poll = poll_every, now = 0, advance;
+
+    for(i = 0; i < NUM_USERS; ++i)
+        fprintf(out, "u user%d\n", i);
+    for(i = 0; i < 2; ++i)
+        fprintf(out, "a %s\n", extra_activities[i]);
+
+    while(created < num_tasks) {
+        burst = 1 + next_random(&seed) % MAX_BURST;
+        for(j = 0; j < burst && created < num_tasks; ++j, ++created)
+            fprintf(out, "t %lu task %08lx\n", 1 + next_random(&seed) % 100,
+                    scramble(created));
+
+        burst = next_random(&seed) % MAX_MOVES;
+        for(j = 0; j < burst; ++j)
+            fprintf(out, "m %lu user%lu %s\n", 1 + next_random(&seed) % created,
+                    next_random(&seed) % NUM_USERS,
+                    move_activities[next_random(&seed) % 4]);
+
+        advance = next_random(&seed) % (MAX_ADVANCE + 1);
+        now += advance;
+        fprintf(out, "n %d\n", advance);
+
+        if(created >= next_poll) {
+            fprintf(out, "l\n");
+            fprintf(out, "d %s\n", move_activities[next_random(&seed) % 4]);
+            fprintf(out, "w user%lu\n", next_random(&seed) % NUM_USERS);
+            j = 1 + next_random(&seed) % 100;
+            fprintf(out, "r %d %d\n", j, j + 4);
+            fprintf(out, "o\n");
+            fprintf(out, "s\n");
+            fprintf(out, "h %lu\n", next_random(&seed) % (now + 1));
+            next_poll += poll_every;
+        }
+    }
+    fprintf(out, "q\n");
+}
+
+/*returns the time elapsed since start in microseconds*/
+double elapsed(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 +
+           (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/*adds the latency, in microseconds, to the stats of a command*/
+void add_latency(command_stats *stats, double latency)
+{
+    int i;
+
+    for(i = 0; i < NUM_BUCKETS - 1 && latency >= (1L << i); ++i);
+
+    stats->buckets[i]++;
+    stats->count++;
+    stats->total += latency;
+    if(latency > stats->max)
+        stats->max = latency;
+}
+
+/*returns the upper bound of the histogram bucket below which are
+percent percent of the latencies*/
+long percentile(command_stats *stats, int percent)
+{
+    int i, seen = 0;
+
+    for(i = 0; i < NUM_BUCKETS - 1; ++i) {
+        seen += stats->buckets[i];
+        if(seen * 100.0 >= stats->count * (double) percent)
+            break;
+    }
+    return 1L << i;
+}
+
+/*prints the count, mean, percentiles and histogram of every command*/
+void report_stats(FILE *report, command_stats stats[])
+{
+    int i, j;
+    char p50[NUM_BUCKETS], p99[NUM_BUCKETS];
+
+    fprintf(report, "  %-7s %9s %10s %9s %9s %10s  %s\n", "command", "count",
+            "mean(us)", "p50(us)", "p99(us)", "max(us)", "histogram (us)");
+    for(i = 0; i < NUM_COMMANDS; ++i) {
+        if(stats[i].count == 0)
+            continue;
+        sprintf(p50, "<%ld", percentile(&stats[i], 50));
+        sprintf(p99, "<%ld", percentile(&stats[i], 99));
+        fprintf(report, "  %-7c %9d %10.2f %9s %9s %10.1f ", COMMANDS[i],
+                stats[i].count, stats[i].total / stats[i].count, p50, p99,
+                stats[i].max);
+        for(j = 0; j < NUM_BUCKETS; ++j)
+            if(stats[i].buckets[j] != 0)
+                fprintf(report, " <%ld:%d", 1L << j, stats[i].buckets[j]);
+        fprintf(report, "\n");
+    }
+}
+
+
+/*runs the commands in input timing each one until q, or until the budget of
+seconds is over, returns TRUE if all commands were run*/
+int run_workload(FILE *report, int num_tasks, double budget)
+{
+    Board *b;
+    command_stats stats[NUM_COMMANDS];
+    struct timespec start, run;
+    double latency, total;
+    int c, i, count = 0, finished = TRUE;
+    char *command;
+
+    memset(stats, 0, sizeof(stats));
+    b = select_board(DEFAULT_BOARD);
+
+    clock_gettime(CLOCK_MONOTONIC, &run);
+    while((c = getchar()) != 'q' && c != EOF) {
+        if((command = strchr(COMMANDS, c)) == NULL)
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        b = run_command(b, c);
+        latency = elapsed(&start);
+
+        i = command - COMMANDS;
+        add_latency(&stats[i], latency);
+        count++;
+
+        if(elapsed(&run) > budget * 1e6) {
+            finished = FALSE;
+            break;
+        }
+    }
+    fflush(stdout);
+    total = elapsed(&run) / 1e6;
+
+    if(finished)
+        fprintf(report, "tasks=%d:", num_tasks);
+    else
+        fprintf(report, "tasks=%d: stopped by the budget after %d tasks,",
+                num_tasks, b->num_task);
+    fprintf(report, " %d commands in %.3f s, %.1f commands/sec\n", count,
+            total, count / total);
+    report_stats(report, stats);
+    fflush(report);
+    free_boards();
+
+    return finished;
+}
+
+/*reads the options of the benchmark*/
+void read_options(int argc, char *argv[], int *max_tasks, double *budget,
+                  unsigned long *seed)
+{
+    int i;
+
+    *max_tasks = MAX_TASK;
+    *budget = BUDGET;
+    *seed = SEED;
+
+    for(i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "-t") == 0)
+            *max_tasks = atoi(argv[i + 1]);
+        else if(strcmp(argv[i], "-b") == 0)
+            *budget = atof(argv[i + 1]);
+        else if(strcmp(argv[i], "-s") == 0)
+            *seed = strtoul(argv[i + 1], NULL, 10);
+    }
+    if(*max_tasks > MAX_TASK || *max_tasks < MIN_TASKS)
+        *max_tasks = MAX_TASK;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *input, *report;
+    int num_tasks, max_tasks;
+    double budget;
+    unsigned long seed;
+
+    read_options(argc, argv, &max_tasks, &budget, &seed);
+
+    /*proj1 reads from stdin and writes to stdout, so stdin is replaced by each
+    workload and its output is discarded while the report goes to the old stdout*/
+    fflush(stdout);
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    freopen("/dev/null", "w", stdout);
+
+    for(num_tasks = MIN_TASKS; num_tasks <= max_tasks; num_tasks *= 10) {
+        input = tmpfile();
+        write_workload(input, num_tasks, seed);
+        fflush(input);
+        dup2(fileno(input), STDIN_FILENO);
+        fseek(stdin, 0, SEEK_SET); /*drops what was buffered from the last run*/
+        clearerr(stdin);
+
+        if(!run_workload(report, num_tasks, budget)) {
+            fclose(input);
+            break;
+        }
+        fclose(input);
+    }
+    fclose(report);
+    return 0;
+}
@@ -0,0 +1,344 @@
+/*
+ * File: bench2.c
+ * Author: Sofia Pinho
+ * Description: A benchmark for the hierarchical storage system of proj2. It
+ * generates a synthetic workload, runs it through the commands of proj2 and
+ * reports the throughput, latency percentiles and peak memory of each command.
+ *
+ * Build: gcc -O2 -Wall -Wextra -ansi -pedantic -o bench2 bench2.c store.c
+ * Usage: bench2 [-d depth] [-f fanout] [-v value_size] [-n operations]
+ *               [-m set:find:list:search:delete:print] [-s seed] [-g]
+ * With -g the workload is written to the output instead of being run, so it
+ * can also be given to proj2 itself.
+*/
+
+#define _XOPEN_SOURCE 600
+
+#define main proj2_main
+#include "proj2.c"
+#undef main
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define NUM_COMMANDS  6
+#define NUM_VALUES    32 /* number of distinct values in the workload */
+#define MISS_PERCENT  10 /* percentage of searches for a value that isn't stored */
+#define MAX_DEPTH     64
+/* default workload */
+#define DEPTH         4
+#define FANOUT        8
+#define VALUE_SIZE    16
+#define OPERATIONS    20000
+#define MIX           "40:40:8:5:5:2"
+#define SEED          1
+
+/* the commands measured, in the order used by the mix of the workload */
+const char *command_names[NUM_COMMANDS] = {"set", "find", "list", "search",
+                                           "delete", "print"};
+
+/* the parameters of a synthetic workload */
+typedef struct {
+    int depth, fanout, value_size, operations;
+    int mix[NUM_COMMANDS];
+    unsigned long seed;
+} workload;
+
+/* the latencies, in microseconds, measured for one command */
+typedef struct {
+    double *latencies;
+    int count, size;
+    double total;
+} command_stats;
+
+/* returns the next number of the pseudo random sequence that starts at
+seed, the same on every platform so that workloads are reproducible */
+unsigned long next_random(unsigned long *seed)
+{
+    *seed = (*seed * 1103515245UL + 12345UL) & 0xffffffffUL;
+    return *seed >> 8;
+}
+
+/* writes a path with depth directories, each one chosen at random
+among the fanout possible ones */
+void write_path(FILE *out, workload *w, int depth)
+{
+    int i;
+
+    for(i = 0; i < depth; i++)
+        fprintf(out, "/d%lu", next_random(&w->seed) % w->fanout);
+}
+
+/* writes the value number n of the workload */
+void write_value(FILE *out, workload *w, int n)
+{
+    int i;
+
+    fprintf(out, "v%d", n);
+    for(i = 0; i < w->value_size - 3; i++)
+        putc('a' + (n + i) % 26, out);
+}
+
+/* writes a set command for every path of maximum depth of the workload,
+returns the number of commands written */
+int write_preload(FILE *out, workload *w)
+{
+    int dirs[MAX_DEPTH], i, count = 0;
+
+    for(i = 0; i < w->depth; i++)
+        dirs[i] = 0;
+
+    while(dirs[0] < w->fanout) {
+        fprintf(out, "set ");
+        for(i = 0; i < w->depth; i++)
+            fprintf(out, "/d%d", dirs[i]);
+        putc(' ', out);
+        write_value(out, w, count % NUM_VALUES);
+        putc('\n', out);
+        count++;
+
+        for(i = w->depth - 1; i > 0 && dirs[i] == w->fanout - 1; i--)
+            dirs[i] = 0;
+        dirs[i]++;
+    }
+    return count;
+}
+
+/* writes an operation of the workload chosen at random according to its mix */
+void write_operation(FILE *out, workload *w)
+{
+    int i, total = 0, pick;
+
+    for(i = 0; i < NUM_COMMANDS; i++)
+        total += w->mix[i];
+    pick = next_random(&w->seed) % total;
+    for(i = 0; pick >= w->mix[i]; i++)
+        pick -= w->mix[i];
+
+    fprintf(out, "%s", command_names[i]);
+    switch(i) {
+        case 0: { /* set */
+            putc(' ', out);
+            write_path(out, w, w->depth);
+            putc(' ', out);
+            write_value(out, w, next_random(&w->seed) % NUM_VALUES);
+            break;
+        }
+        case 1: { /* find */
+            putc(' ', out);
+            write_path(out, w, 1 + next_random(&w->seed) % w->depth);
+            break;
+        }
+        case 2: { /* list */
+            pick = next_random(&w->seed) % w->depth;
+            if(pick > 0) {
+                putc(' ', out);
+                write_path(out, w, pick);
+            }
+            break;
+        }
+        case 3: { /* search */
+            putc(' ', out);
+            pick = next_random(&w->seed) % 100;
+            write_value(out, w, pick < MISS_PERCENT ? NUM_VALUES :
+                                pick % NUM_VALUES);
+            break;
+        }
+        case 4: { /* delete */
+            putc(' ', out);
+            write_path(out, w, w->depth);
+            break;
+        }
+    }
+    putc('\n', out);
+}
+
+/* returns the time elapsed since start in microseconds */
+double elapsed(struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 +
+           (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/* returns the peak resident memory of the process in kB */
+long peak_rss()
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/* adds the latency to the stats of a command */
+void add_latency(command_stats *stats, double latency)
+{
+    if(stats->count == stats->size) {
+        stats->size = stats->size == 0 ? 1024 : stats->size * 2;
+        stats->latencies = realloc(stats->latencies,
+                                   stats->size * sizeof(double));
+    }
+    stats->latencies[stats->count++] = latency;
+    stats->total += latency;
+}
+
+/* compares two latencies, used to sort them */
+int cmp_latency(const void *l1, const void *l2)
+{
+    double d1 = *(const double*) l1, d2 = *(const double*) l2;
+
+    return (d1 > d2) - (d1 < d2);
+}
+
+/* returns the latency below which are percent percent of the latencies,
+which must be sorted */
+double percentile(command_stats *stats, int percent)
+{
+    int i = (int) ((stats->count - 1) * (percent / 100.0));
+
+    return stats->latencies[i];
+}
+
+/* prints the throughput and latency percentiles of every command */
+void report_stats(FILE *report, command_stats stats[])
+{
+    int i;
+
+    fprintf(report, "%-8s %8s %12s %10s %10s %10s %10s\n", "command", "ops",
+            "ops/sec", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for(i = 0; i < NUM_COMMANDS; i++) {
+        if(stats[i].count == 0)
+            continue;
+        qsort(stats[i].latencies, stats[i].count, sizeof(double), cmp_latency);
+        fprintf(report, "%-8s %8d %12.1f %10.2f %10.2f %10.2f %10.2f\n",
+                command_names[i], stats[i].count,
+                stats[i].count / (stats[i].total / 1e6),
+                percentile(&stats[i], 50), percentile(&stats[i], 90),
+                percentile(&stats[i], 99), percentile(&stats[i], 100));
+    }
+}
+
+/* runs the commands in input, timing each one, until quit or the end of
+the input, the time of the first num_preload ones isn't included in stats */
+void run_workload(FILE *report, int num_preload, command_stats stats[])
+{
+    char command[MAX_CHAR_INST];
+    store *s = store_open();
+    struct timespec start, preload;
+    double latency;
+    int i, count = 0;
+
+    in = stdin;
+    out = stdout;
+    clock_gettime(CLOCK_MONOTONIC, &preload);
+    while(scanf("%s", command) == 1 && strcmp(command, "quit") != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        run_command(command, s);
+        latency = elapsed(&start);
+
+        if(++count == num_preload)
+            fprintf(report, "preload: %d paths in %.3f s, peak rss %ld kB\n",
+                    num_preload, elapsed(&preload) / 1e6, peak_rss());
+        if(count <= num_preload)
+            continue;
+        for(i = 0; i < NUM_COMMANDS; i++)
+            if(strcmp(command, command_names[i]) == 0)
+                add_latency(&stats[i], latency);
+    }
+    fflush(stdout);
+    report_stats(report, stats);
+    fprintf(report, "peak rss: %ld kB\n", peak_rss());
+
+    store_close(s);
+}
+
+/* reads the options of the benchmark into the workload w, returns TRUE if
+the workload should only be written and FALSE if it should be run */
+int read_options(int argc, char *argv[], workload *w)
+{
+    int i, generate = FALSE;
+    char *mix = MIX;
+
+    w->depth = DEPTH;
+    w->fanout = FANOUT;
+    w->value_size = VALUE_SIZE;
+    w->operations = OPERATIONS;
+    w->seed = SEED;
+
+    for(i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-g") == 0)
+            generate = TRUE;
+        else if(i + 1 < argc && strcmp(argv[i], "-d") == 0)
+            w->depth = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-f") == 0)
+            w->fanout = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-v") == 0)
+            w->value_size = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-n") == 0)
+            w->operations = atoi(argv[++i]);
+        else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+            w->seed = strtoul(argv[++i], NULL, 10);
+        else if(i + 1 < argc && strcmp(argv[i], "-m") == 0)
+            mix = argv[++i];
+    }
+    if(w->depth < 1 || w->depth > MAX_DEPTH)
+        w->depth = DEPTH;
+    if(w->fanout < 1)
+        w->fanout = FANOUT;
+    for(i = 0; i < NUM_COMMANDS; i++) {
+        w->mix[i] = atoi(mix);
+        if(w->mix[i] < 0)
+            w->mix[i] = 0;
+        while(*mix != '\0' && *mix++ != ':');
+    }
+    for(i = 0; i < NUM_COMMANDS && w->mix[i] == 0; i++);
+    if(i == NUM_COMMANDS)
+        w->mix[0] = 1;
+
+    return generate;
+}
+
+int main(int argc, char *argv[])
+{
+    workload w;
+    command_stats stats[NUM_COMMANDS];
+    FILE *input, *report;
+    int i, num_preload;
+
+    memset(stats, 0, sizeof(stats));
+    if(read_options(argc, argv, &w)) {
+        write_preload(stdout, &w);
+        for(i = 0; i < w.operations; i++)
+            write_operation(stdout, &w);
+        printf("quit\n");
+        return 0;
+    }
+    fprintf(stdout, "depth=%d fanout=%d value_size=%d operations=%d\n",
+            w.depth, w.fanout, w.value_size, w.operations);
+
+    input = tmpfile();
+    num_preload = write_preload(input, &w);
+    for(i = 0; i < w.operations; i++)
+        write_operation(input, &w);
+    fprintf(input, "quit\n");
+    rewind(input);
+
+    /* proj2 reads from stdin and writes to stdout, so stdin is replaced by the
+    workload and its output is discarded while the report goes to the old
+    stdout */
+    fflush(stdout);
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(fileno(input), STDIN_FILENO);
+    freopen("/dev/null", "w", stdout);
+
+    run_workload(report, num_preload, stats);
+
+    for(i = 0; i < NUM_COMMANDS; i++)
+        free(stats[i].latencies);
+    fclose(report);
+    fclose(input);
+    return 0;
+}
@@ -4,9 +4,25 @@
  * Description: A program that simulates a task management system
 */
 
+#if defined(PARALLEL)
+#define _POSIX_C_SOURCE 200809L /*threads, fmemopen and open_memstream*/
+#elif defined(PROFILE)
+#define _POSIX_C_SOURCE 199309L /*clock_gettime*/
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef PROFILE
+#include <time.h>
+#endif
+#ifdef PARALLEL
+#include <pthread.h>
+#include <unistd.h>
+#define MAX_WORKERS   64 /*max number of threads running commands*/
+#define BATCH         32 /*max commands of a board run before its worker takes another board*/
+#define MAX_JOBS      4096 /*max commands read and not yet written before the reader waits*/
+#endif
 
 #define MAX_DESC_ACTIV 21 /*maximum length of activity descriptions*/
 #define MAX_ACTIV      10 /*max number of activities*/
@@ -15,21 +31,157 @@
 #define MAX_USER      50 /*max number of users*/
 
 #define MAX_DESC_TASK 51 /*maximum length of task descriptions*/
+#ifndef MAX_TASK
 #define MAX_TASK      10000 /*max number of tasks*/
+#endif
 
 /*constants used in functions that evaluate whether input is valid or not*/
 #define VALID         1
 #define INVALID       0
 #define TRUE          1
 #define FALSE         0
-/*constants used to distinguish alphabetical from start instance based sorting*/
-#define ALPH          1
-#define START_INST    0
+#define NONE          -1 /*index of a task or user that doesn't exist*/
+#define CREATED       255 /*activity a task comes from in the transition that creates it*/
+#define MIN_CHECKPOINT 1024 /*min number of transitions between two checkpoints*/
+#define MAX_BOARD_CHARS 20 /*max number of chars of board names*/
+#define MAX_DESC_BOARD (MAX_BOARD_CHARS + 1) /*maximum length of board names*/
+#define STRINGIFY(x)  #x
+#define FORMAT_WIDTH(x) STRINGIFY(x) /*the value of the constant x as a string*/
+/*reads a board name, dropping the chars past the first MAX_BOARD_CHARS*/
+#define BOARD_FORMAT  "%" FORMAT_WIDTH(MAX_BOARD_CHARS) "s%*[^ \t\n]"
+#define INIT_TASKS    64 /*number of tasks a new board has room for*/
+#define INIT_CHECKPOINTS 16 /*number of checkpoints a new board has room for*/
+#ifndef MAX_LOADED
+#define MAX_LOADED    64 /*max number of boards kept in memory*/
+#endif
+#define DEFAULT_BOARD "default" /*board selected when the program starts*/
 /*default activities descriptions*/
 #define TO_DO_DESC    "TO DO"
 #define IN_P_DESC     "IN PROGRESS"
 #define DONE_DESC     "DONE"
 
+/*profiling of commands and of the events that dominate their cost, compiled
+in only with -DPROFILE so that it costs nothing otherwise*/
+#ifdef PROFILE
+#define PROFILED      "tlnumdawroshbp" /*commands profiled*/
+#define NUM_PROFILED  14
+#define NUM_BUCKETS   32 /*bucket i counts latencies below 2^i microseconds*/
+#define PROFILE_EVENT(event) (COUNTERS->events[event]++)
+
+/*string compares done by the sort and by the linear searches, and exchanges
+done by the sort*/
+enum {EV_LESS_ALPH, EV_LESS_INST, EV_SCAN_STRCMP, EV_EXCH, NUM_EVENTS};
+
+const char *event_names[NUM_EVENTS] = {"less_alph", "less_inst", "scan_strcmp", "exch"};
+
+/*type used to store the calls, total time and latency histogram of a command*/
+typedef struct
+{
+    unsigned long calls;
+    double total;
+    unsigned long histogram[NUM_BUCKETS];
+} command_profile;
+
+/*type used to store the profiles of the commands and the event counters*/
+typedef struct
+{
+    command_profile profiles[NUM_PROFILED];
+    unsigned long events[NUM_EVENTS];
+} counters;
+
+counters totals; /*counters printed at the end*/
+
+/*with -DPARALLEL each worker counts in its own counters, found through
+counters_key, and they're added to the totals when it ends, so that workers
+never write to the same counters*/
+#ifdef PARALLEL
+pthread_key_t counters_key;
+#define COUNTERS ((counters*) pthread_getspecific(counters_key))
+#else
+#define COUNTERS (&totals)
+#endif
+
+/*adds the time elapsed since start to the profile of the command c*/
+void profile_command(char c, struct timespec *start)
+{
+    struct timespec now;
+    double latency;
+    char *command = strchr(PROFILED, c);
+    command_profile *profile;
+    int i;
+
+    if(c == '\0' || command == NULL)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency = (now.tv_sec - start->tv_sec) * 1e6 + 
+              (now.tv_nsec - start->tv_nsec) / 1e3;
+
+    for(i = 0; i < NUM_BUCKETS - 1 && latency >= (1L << i); ++i);
+
+    profile = &COUNTERS->profiles[command - PROFILED];
+    profile->calls++;
+    profile->total += latency;
+    profile->histogram[i]++;
+}
+
+/*adds the counters c to the totals*/
+void add_counters(counters *c)
+{
+    int i, j;
+
+    for(i = 0; i < NUM_PROFILED; ++i) {
+        totals.profiles[i].calls += c->profiles[i].calls;
+        totals.profiles[i].total += c->profiles[i].total;
+        for(j = 0; j < NUM_BUCKETS; ++j)
+            totals.profiles[i].histogram[j] += c->profiles[i].histogram[j];
+    }
+    for(i = 0; i < NUM_EVENTS; ++i)
+        totals.events[i] += c->events[i];
+}
+
+/*prints the profile of every command that was called and the event counters*/
+void print_profile(FILE *out)
+{
+    command_profile *profiles = totals.profiles;
+    int i, j;
+
+    fprintf(out, "%-7s %10s %12s %10s  %s\n", "command", "calls", "total(us)",
+            "mean(us)", "histogram (us)");
+    for(i = 0; i < NUM_PROFILED; ++i) {
+        if(profiles[i].calls == 0)
+            continue;
+        fprintf(out, "%-7c %10lu %12.1f %10.2f ", PROFILED[i], profiles[i].calls,
+                profiles[i].total, profiles[i].total / profiles[i].calls);
+        for(j = 0; j < NUM_BUCKETS; ++j)
+            if(profiles[i].histogram[j] != 0)
+                fprintf(out, " <%ld:%lu", 1L << j, profiles[i].histogram[j]);
+        fprintf(out, "\n");
+    }
+    for(i = 0; i < NUM_EVENTS; ++i)
+        fprintf(out, "%s=%lu%c", event_names[i], totals.events[i],
+                i == NUM_EVENTS - 1 ? '\n' : ' ');
+}
+#else
+#define PROFILE_EVENT(event)
+#endif
+
+/*type used to store, in as few bytes as possible, a change of the activity
+or user of a task at some time, or its creation*/
+typedef struct
+{
+    int task, time;
+    unsigned char from, to; /*indexes of the activities, from is CREATED on creation*/
+    unsigned char user; /*index of the user plus one, 0 if the task has no user*/
+} Transition;
+
+/*type used to store a copy of the activity of every task after some transition*/
+typedef struct
+{
+    int pos; /*number of transitions in the log when the copy was made*/
+    int num_task;
+    unsigned char *activ; /*index of the activity of each task*/
+} Checkpoint;
+
 /*categories in which the project tasks are divided and that
 represent a specific operation*/
 typedef struct activity
@@ -44,86 +196,560 @@ typedef struct
     char desc[MAX_DESC_USER];
 } User;
 
-/*type used to represent and store all relevant information
-connected to each task*/
-typedef struct task
+/*type used to store everything about one board, its activities, users and tasks,
+so that many boards are kept by the same process, the arrays with a position for
+each task grow with the number of tasks and are written to a snapshot, and freed,
+when the board is evicted*/
+typedef struct board
 {
-    int id;
-    char desc[MAX_DESC_TASK];
-    User user;
-    Activity activ;
-    int dur, start_inst;
-} Task;
+    char name[MAX_DESC_BOARD];
+    Activity activities[MAX_ACTIV]; /*array of activities in the board*/
+    User users[MAX_USER]; /*array of users in the board*/
+    int activ_to_do, activ_done; /*indexes of the default activities*/
+
+    /*variables that allow to keep track of time and the number of elements in the board*/
+    int current_time, num_activ, num_user, num_task;
+    int task_cap; /*number of tasks the arrays below have room for*/
+
+    /*tasks are stored by columns indexed by the task index, the id of a task being its
+    index plus one, so that going through one field of all tasks only reads that field*/
+    int *task_activ; /*index in activities of the activity of each task*/
+    int *task_user; /*index in users of the user of each task, NONE if it has none*/
+    int *task_dur, *task_start; /*duration and start instance of each task*/
+    int *desc_pos; /*position of the description of each task in desc_pool*/
+    char *desc_pool; /*descriptions of all tasks one after another*/
+    int pool_used, pool_cap; /*number of characters used and allocated in desc_pool*/
+
+    /*secondary indexes kept up to date by the t and m commands, so that the tasks
+    of a user or in a range of durations are found without going through all tasks*/
+    int user_first[MAX_USER]; /*index of the first task of each user, NONE if it has none*/
+    int *user_next, *user_prev; /*links between the tasks of the same user*/
+    /*balanced tree of all tasks sorted by duration, and by id for equal durations,
+    so that adding a task and finding the first one in a range are logarithmic*/
+    int dur_root; /*index of the task at the root of the tree, NONE if there are none*/
+    int *dur_left, *dur_right; /*children of each task in the tree, NONE if missing*/
+    int *dur_height; /*height of the subtree rooted at each task*/
+
+    /*tasks in progress, those that started and aren't done, are kept in a heap ordered
+    by deadline until time passes it and then moved to the list of overdue tasks, so
+    that n and o only go through the tasks that are or become overdue*/
+    int *heap, heap_size; /*binary heap of the tasks in progress not yet overdue*/
+    int *heap_pos; /*position of each task in the heap, NONE if it isn't there*/
+    int overdue_first, overdue_last; /*list of overdue tasks in progress*/
+    int *overdue_next, *overdue_prev; /*links between overdue tasks*/
+    int *is_overdue; /*whether each task is in the list of overdue tasks*/
+
+    /*aggregates reported by the s command, kept up to date by the t and m commands*/
+    int activ_count[MAX_ACTIV]; /*number of tasks in each activity*/
+    long activ_dur[MAX_ACTIV]; /*sum of the durations of the tasks in each activity*/
+    int slack_count, slack_min, slack_max; /*slacks of the moves to DONE*/
+    long slack_total;
+
+    /*append only log of all transitions, with a checkpoint of the activities of all
+    tasks taken whenever the log grows by as many transitions as there are tasks, so
+    that the board at a past time is rebuilt from a checkpoint and a tail no longer
+    than it*/
+    Transition *history;
+    int history_size, history_cap;
+    Checkpoint *checkpoints;
+    int num_checkpoints, checkpoints_cap;
+
+    int *scratch; /*room for an index of each task, used by the commands that sort tasks*/
+
+    FILE *in, *out; /*where the commands of the board are read from and written to*/
+    FILE *snapshot; /*the arrays of the board when it's evicted, NULL when it's loaded*/
+    long last_used; /*value of board_clock when the board was last selected*/
+    int pending; /*number of commands of the board waiting to be run or running*/
+#ifdef PARALLEL
+    struct job *first_job, *last_job; /*commands of the board waiting to be run*/
+    int scheduled; /*whether the board is in a deque or being run by a worker*/
+#endif
+} Board;
+
+/*global variables with all boards in the order they were created and the number of
+them in memory, the least recently used ones are evicted when there are too many*/
+Board **boards = NULL;
+int num_boards = 0, boards_cap = 0, num_loaded = 0;
+long board_clock = 0;
+
+/*returns the description of the task with index i*/
+char *task_desc(Board *b, int i)
+{
+    return &b->desc_pool[b->desc_pos[i]];
+}
+
+/*returns the index of the user with description desc, NONE if there's no such user*/
+int user_index(Board *b, char desc[])
+{
+    int i;
+
+    for(i = 0; i < b->num_user; ++i) {
+        PROFILE_EVENT(EV_SCAN_STRCMP);
+        if(strcmp(desc, b->users[i].desc) == 0)
+            return i;
+    }
+    return NONE;
+}
+
+/*returns the index of the activity with description desc, NONE if there's no such activity*/
+int activ_index(Board *b, char desc[])
+{
+    int i;
+
+    for(i = 0; i < b->num_activ; ++i) {
+        PROFILE_EVENT(EV_SCAN_STRCMP);
+        if(strcmp(desc, b->activities[i].desc) == 0)
+            return i;
+    }
+    return NONE;
+}
+
+/*adds the task with index i to the list of tasks of its user*/
+void link_user_task(Board *b, int i)
+{
+    int u = b->task_user[i];
+
+    b->user_prev[i] = NONE;
+    b->user_next[i] = NONE;
+    if(u == NONE) /*tasks created before any user have none*/
+        return;
+
+    b->user_next[i] = b->user_first[u];
+    if(b->user_first[u] != NONE)
+        b->user_prev[b->user_first[u]] = i;
+    b->user_first[u] = i;
+}
+
+/*removes the task with index i from the list of tasks of its user*/
+void unlink_user_task(Board *b, int i)
+{
+    int u = b->task_user[i];
+
+    if(u == NONE)
+        return;
+
+    if(b->user_prev[i] != NONE)
+        b->user_next[b->user_prev[i]] = b->user_next[i];
+    else
+        b->user_first[u] = b->user_next[i];
+    if(b->user_next[i] != NONE)
+        b->user_prev[b->user_next[i]] = b->user_prev[i];
+}
+
+/*changes the activity of the task with index i to the activity with index a*/
+void change_activ(Board *b, int i, int a)
+{
+    b->activ_count[b->task_activ[i]]--;
+    b->activ_dur[b->task_activ[i]] -= b->task_dur[i];
+    b->task_activ[i] = a;
+    b->activ_count[a]++;
+    b->activ_dur[a] += b->task_dur[i];
+}
+
+/*changes the user of the task with index i to the user with index u*/
+void change_user(Board *b, int i, int u)
+{
+    unlink_user_task(b, i);
+    b->task_user[i] = u;
+    link_user_task(b, i);
+}
+
+/*verifies whether the task with index i1 comes before the task with index i2
+in the tree by duration, by id if they have the same duration*/
+int less_dur(Board *b, int i1, int i2)
+{
+    return b->task_dur[i1] < b->task_dur[i2] || 
+           (b->task_dur[i1] == b->task_dur[i2] && i1 < i2);
+}
+
+/*returns the height of the subtree by duration rooted at the task with index i*/
+int dur_height(Board *b, int i)
+{
+    return i == NONE ? 0 : b->dur_height[i];
+}
 
-Activity activities[MAX_ACTIV]; /*array of activities in the system*/
-User users[MAX_USER]; /*array of users in the system*/
-Task tasks[MAX_TASK]; /*array of tasks in the system*/
+/*recomputes the height of the task with index i from the heights of its children*/
+void update_dur_height(Board *b, int i)
+{
+    int left = dur_height(b, b->dur_left[i]), right = dur_height(b, b->dur_right[i]);
 
-/*global variables that allow to keep track of time and 
-the number of elements in the system*/
-int time = 0, num_activ = 0, num_user = 0, num_task = 0;
+    b->dur_height[i] = 1 + (left > right ? left : right);
+}
+
+/*rotates the subtree rooted at the task with index i so that its left child
+(its right child if left is FALSE) takes its place, returns the new root*/
+int rotate_dur(Board *b, int i, int left)
+{
+    int *up = left ? b->dur_left : b->dur_right, *down = left ? b->dur_right : b->dur_left;
+    int child = up[i];
+
+    up[i] = down[child];
+    down[child] = i;
+    update_dur_height(b, i);
+    update_dur_height(b, child);
+    return child;
+}
+
+/*restores the balance of the subtree rooted at the task with index i, whose
+children differ in height by at most two, returns the new root*/
+int balance_dur(Board *b, int i)
+{
+    int diff = dur_height(b, b->dur_left[i]) - dur_height(b, b->dur_right[i]);
+
+    update_dur_height(b, i);
+    if(diff > 1) {
+        if(dur_height(b, b->dur_left[b->dur_left[i]]) < 
+           dur_height(b, b->dur_right[b->dur_left[i]]))
+            b->dur_left[i] = rotate_dur(b, b->dur_left[i], FALSE);
+        return rotate_dur(b, i, TRUE);
+    }
+    if(diff < -1) {
+        if(dur_height(b, b->dur_right[b->dur_right[i]]) < 
+           dur_height(b, b->dur_left[b->dur_right[i]]))
+            b->dur_right[i] = rotate_dur(b, b->dur_right[i], TRUE);
+        return rotate_dur(b, i, FALSE);
+    }
+    return i;
+}
 
-/*adds a new task to the system and increases the global task counter
+/*adds the task with index i to the subtree by duration rooted at the task with
+index root, returns the new root*/
+int insert_dur(Board *b, int root, int i)
+{
+    if(root == NONE) {
+        b->dur_left[i] = b->dur_right[i] = NONE;
+        b->dur_height[i] = 1;
+        return i;
+    }
+    if(less_dur(b, i, root))
+        b->dur_left[root] = insert_dur(b, b->dur_left[root], i);
+    else
+        b->dur_right[root] = insert_dur(b, b->dur_right[root], i);
+    return balance_dur(b, root);
+}
+
+/*adds the task with index i to the tasks sorted by duration*/
+void insert_by_dur(Board *b, int i)
+{
+    b->dur_root = insert_dur(b, b->dur_root, i);
+}
+
+/*returns the last instant in which the task with index i isn't overdue*/
+int deadline(Board *b, int i)
+{
+    return b->task_start[i] + b->task_dur[i];
+}
+
+/*verifies whether the deadline of the task with index i1 comes before the
+one of the task with index i2, by id if they're the same*/
+int less_deadline(Board *b, int i1, int i2)
+{
+    return deadline(b, i1) < deadline(b, i2) || 
+           (deadline(b, i1) == deadline(b, i2) && i1 < i2);
+}
+
+/*puts the task with index i at position pos of the heap*/
+void heap_set(Board *b, int pos, int i)
+{
+    b->heap[pos] = i;
+    b->heap_pos[i] = pos;
+}
+
+/*moves the task at position pos of the heap up until its parent comes before it*/
+void fix_up(Board *b, int pos)
+{
+    int i = b->heap[pos];
+
+    while(pos > 0 && less_deadline(b, i, b->heap[(pos - 1) / 2])) {
+        heap_set(b, pos, b->heap[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    heap_set(b, pos, i);
+}
+
+/*moves the task at position pos of the heap down until it comes before its children*/
+void fix_down(Board *b, int pos)
+{
+    int i = b->heap[pos], child;
+
+    while((child = 2 * pos + 1) < b->heap_size) {
+        if(child + 1 < b->heap_size && less_deadline(b, b->heap[child + 1], b->heap[child]))
+            child++;
+        if(!less_deadline(b, b->heap[child], i))
+            break;
+        heap_set(b, pos, b->heap[child]);
+        pos = child;
+    }
+    heap_set(b, pos, i);
+}
+
+/*adds the task with index i to the heap*/
+void heap_insert(Board *b, int i)
+{
+    heap_set(b, b->heap_size++, i);
+    fix_up(b, b->heap_size - 1);
+}
+
+/*removes the task with index i from the heap*/
+void heap_remove(Board *b, int i)
+{
+    int pos = b->heap_pos[i], last = b->heap[--b->heap_size];
+
+    b->heap_pos[i] = NONE;
+    if(pos == b->heap_size)
+        return;
+
+    heap_set(b, pos, last);
+    fix_up(b, pos);
+    fix_down(b, b->heap_pos[last]);
+}
+
+/*adds the task with index i to the end of the list of overdue tasks*/
+void append_overdue(Board *b, int i)
+{
+    b->is_overdue[i] = TRUE;
+    b->overdue_next[i] = NONE;
+    b->overdue_prev[i] = b->overdue_last;
+    if(b->overdue_last != NONE)
+        b->overdue_next[b->overdue_last] = i;
+    else
+        b->overdue_first = i;
+    b->overdue_last = i;
+}
+
+/*moves the tasks whose deadline has passed from the heap to the end of the
+list of overdue tasks, in order of deadline*/
+void update_overdue(Board *b)
+{
+    int i;
+
+    while(b->heap_size > 0 && deadline(b, b->heap[0]) < b->current_time) {
+        i = b->heap[0];
+        heap_remove(b, i);
+        append_overdue(b, i);
+    }
+}
+
+/*removes the task with index i from the list of overdue tasks*/
+void unlink_overdue(Board *b, int i)
+{
+    if(b->overdue_prev[i] != NONE)
+        b->overdue_next[b->overdue_prev[i]] = b->overdue_next[i];
+    else
+        b->overdue_first = b->overdue_next[i];
+    if(b->overdue_next[i] != NONE)
+        b->overdue_prev[b->overdue_next[i]] = b->overdue_prev[i];
+    else
+        b->overdue_last = b->overdue_prev[i];
+    b->is_overdue[i] = FALSE;
+}
+
+/*starts or stops following the deadline of the task with index i when it
+enters or leaves the activities between TO DO and DONE*/
+void update_deadline(Board *b, int i, int activ_to_do, int activ_done)
+{
+    int in_progress = b->task_activ[i] != activ_to_do && b->task_activ[i] != activ_done;
+
+    if(!in_progress) {
+        if(b->heap_pos[i] != NONE)
+            heap_remove(b, i);
+        else if(b->is_overdue[i])
+            unlink_overdue(b, i);
+    }
+    else if(b->heap_pos[i] == NONE && !b->is_overdue[i]) {
+        heap_insert(b, i);
+        update_overdue(b);
+    }
+}
+
+/*copies the activities of all tasks into a new checkpoint*/
+void add_checkpoint(Board *b)
+{
+    Checkpoint *c;
+    int i;
+
+    if(b->num_checkpoints == b->checkpoints_cap) {
+        b->checkpoints_cap *= 2;
+        b->checkpoints = realloc(b->checkpoints, b->checkpoints_cap * sizeof(Checkpoint));
+    }
+    c = &b->checkpoints[b->num_checkpoints++];
+    c->pos = b->history_size;
+    c->num_task = b->num_task;
+    c->activ = malloc(b->num_task + 1);
+    for(i = 0; i < b->num_task; ++i)
+        c->activ[i] = b->task_activ[i];
+}
+
+/*appends to the log the transition of the task with index i from the activity with
+index from to its current activity and user, taking a checkpoint if it's time to*/
+void log_transition(Board *b, int i, int from)
+{
+    Transition *tr;
+    int last = b->num_checkpoints == 0 ? 0 : b->checkpoints[b->num_checkpoints - 1].pos;
+
+    if(b->history_size == b->history_cap) {
+        b->history_cap *= 2;
+        b->history = realloc(b->history, b->history_cap * sizeof(Transition));
+    }
+    tr = &b->history[b->history_size++];
+    tr->task = i;
+    tr->time = b->current_time;
+    tr->from = from;
+    tr->to = b->task_activ[i];
+    tr->user = b->task_user[i] + 1;
+
+    if(b->history_size - last >= MIN_CHECKPOINT && b->history_size - last >= b->num_task)
+        add_checkpoint(b);
+}
+
+
+/*stores in activ the activity of every task at the end of the instant time,
+returning the number of tasks that existed then*/
+int board_at(Board *b, int time, int activ[])
+{
+    int left = 0, right = b->history_size, middle, end, count = 0;
+    Checkpoint *c = NULL;
+
+    /*end is the number of transitions up to time*/
+    while(left < right) {
+        middle = (left + right) / 2;
+        if(b->history[middle].time <= time)
+            left = middle + 1;
+        else
+            right = middle;
+    }
+    end = left;
+
+    /*the last checkpoint taken before the transition at end*/
+    left = 0;
+    right = b->num_checkpoints;
+    while(left < right) {
+        middle = (left + right) / 2;
+        if(b->checkpoints[middle].pos <= end)
+            left = middle + 1;
+        else
+            right = middle;
+    }
+    if(left > 0) {
+        c = &b->checkpoints[left - 1];
+        for(count = 0; count < c->num_task; ++count)
+            activ[count] = c->activ[count];
+    }
+
+    for(left = c == NULL ? 0 : c->pos; left < end; ++left) {
+        activ[b->history[left].task] = b->history[left].to;
+        if(b->history[left].from == CREATED)
+            count = b->history[left].task + 1;
+    }
+    return count;
+}
+
+/*changes the number of tasks the arrays of the board have room for to cap*/
+void resize_tasks(Board *b, int cap)
+{
+    b->task_cap = cap;
+    b->task_activ = realloc(b->task_activ, cap * sizeof(int));
+    b->task_user = realloc(b->task_user, cap * sizeof(int));
+    b->task_dur = realloc(b->task_dur, cap * sizeof(int));
+    b->task_start = realloc(b->task_start, cap * sizeof(int));
+    b->desc_pos = realloc(b->desc_pos, cap * sizeof(int));
+    b->user_next = realloc(b->user_next, cap * sizeof(int));
+    b->user_prev = realloc(b->user_prev, cap * sizeof(int));
+    b->dur_left = realloc(b->dur_left, cap * sizeof(int));
+    b->dur_right = realloc(b->dur_right, cap * sizeof(int));
+    b->dur_height = realloc(b->dur_height, cap * sizeof(int));
+    b->heap = realloc(b->heap, cap * sizeof(int));
+    b->heap_pos = realloc(b->heap_pos, cap * sizeof(int));
+    b->overdue_next = realloc(b->overdue_next, cap * sizeof(int));
+    b->overdue_prev = realloc(b->overdue_prev, cap * sizeof(int));
+    b->is_overdue = realloc(b->is_overdue, cap * sizeof(int));
+    b->scratch = realloc(b->scratch, cap * sizeof(int));
+}
+
+/*makes room in the board for one more task with a description of length characters*/
+void grow_tasks(Board *b, int length)
+{
+    if(b->num_task == b->task_cap)
+        resize_tasks(b, 2 * b->task_cap);
+
+    if(b->pool_used + length + 1 > b->pool_cap) {
+        b->pool_cap = 2 * (b->pool_used + length + 1);
+        b->desc_pool = realloc(b->desc_pool, b->pool_cap);
+    }
+}
+
+/*adds a new task to the board and increases its task counter
 and returns the new task id*/
-int create_task(char desc[], User user, Activity activ, int dur)
+int create_task(Board *b, char desc[], int user, int activ, int dur)
 {
     int id;
     
-    id = num_task + 1;
-    tasks[num_task].id = id;
-    strcpy(tasks[num_task].desc, desc);
-    tasks[num_task].activ = activ;
-    tasks[num_task].user = user;
-    tasks[num_task].dur = dur;
-    tasks[num_task].start_inst = 0;
-
-    num_task++;
+    id = b->num_task + 1;
+    grow_tasks(b, strlen(desc));
+    b->desc_pos[b->num_task] = b->pool_used;
+    strcpy(task_desc(b, b->num_task), desc);
+    b->pool_used += strlen(desc) + 1;
+    b->task_activ[b->num_task] = activ;
+    b->task_user[b->num_task] = user;
+    b->task_dur[b->num_task] = dur;
+    b->task_start[b->num_task] = 0;
+    b->activ_count[activ]++;
+    b->activ_dur[activ] += dur;
+
+    link_user_task(b, b->num_task);
+    insert_by_dur(b, b->num_task);
+    b->heap_pos[b->num_task] = NONE;
+    b->is_overdue[b->num_task] = FALSE;
+
+    b->num_task++;
+    log_transition(b, b->num_task - 1, CREATED);
 
     return id;
 }
 
 /*verifies if the input in the t command is valid*/
-int t_valid_input(char desc[], int dur)
+int t_valid_input(Board *b, char desc[], int dur)
 {
     int i;
     
-    if(num_task >= MAX_TASK) {
-        printf("too many tasks\n");
+    if(b->num_task >= MAX_TASK) {
+        fprintf(b->out, "too many tasks\n");
         return INVALID;
     }
 
-    for(i = 0; i < num_task; ++i) {
-        if(strcmp(desc, tasks[i].desc) == 0) {
-            printf("duplicate description\n");
+    for(i = 0; i < b->num_task; ++i) {
+        PROFILE_EVENT(EV_SCAN_STRCMP);
+        if(strcmp(desc, task_desc(b, i)) == 0) {
+            fprintf(b->out, "duplicate description\n");
             return INVALID;
         }
     }
     
     if(dur <= 0) {
-        printf("invalid duration\n");
+        fprintf(b->out, "invalid duration\n");
         return INVALID;
     }
 
     return VALID;
 }
 
-/*executes the t command, creating a new task*/
-void t(User user, Activity activ_to_do)
+/*executes the t command, creating a new task of the user with index user*/
+void t(Board *b, int user, int activ_to_do)
 {
     int dur, id;
     char desc_task[MAX_DESC_TASK];
 
-    scanf("%d", &dur);
+    fscanf(b->in, "%d", &dur);
     
-    getchar(); /*space*/
-    fgets(desc_task, MAX_DESC_TASK, stdin);
+    getc(b->in); /*space*/
+    fgets(desc_task, MAX_DESC_TASK, b->in);
     if (desc_task[strlen(desc_task)-1] == '\n')
         desc_task[strlen(desc_task)-1] = '\0';
 
-    if(t_valid_input(desc_task, dur) == VALID) {
-        id = create_task(desc_task, user, activ_to_do, dur);
+    if(t_valid_input(b, desc_task, dur) == VALID) {
+        id = create_task(b, desc_task, user, activ_to_do, dur);
 
-        printf("task %d\n", id);
+        fprintf(b->out, "task %d\n", id);
     }    
 }
 
@@ -132,200 +758,195 @@ void exch(int v[], int ind1, int ind2)
 {
     int temp = v[ind1];
 
+    PROFILE_EVENT(EV_EXCH);
     v[ind1] = v[ind2];
     v[ind2] = temp;
 }
 
 /*returns TRUE if the description of the task with index id1 comes first compared to
 the description of the task with index id2 in alphabetical order*/
-int less_alph(int id1, int id2)
+int less_alph(Board *b, int id1, int id2)
 {
-    return (strcmp(tasks[id1].desc, tasks[id2].desc) < 0);
+    PROFILE_EVENT(EV_LESS_ALPH);
+    return (strcmp(task_desc(b, id1), task_desc(b, id2)) < 0);
 }
 
 /*returns TRUE if the task with index id1 began earlier than the task with index id2,
 if they began at the same time returns TRUE if the description of the task with id1 
 comes first in alphabetical order*/
-int less_inst(int id1, int id2)
+int less_inst(Board *b, int id1, int id2)
 {
-    if(tasks[id1].start_inst < tasks[id2].start_inst)
+    PROFILE_EVENT(EV_LESS_INST);
+    if(b->task_start[id1] < b->task_start[id2])
         return TRUE;
 
-    if((tasks[id1].start_inst == tasks[id2].start_inst) && 
-        less_alph(id1, id2))
+    if((b->task_start[id1] == b->task_start[id2]) && 
+        less_alph(b, id1, id2))
         return TRUE;
     return FALSE;
 }
 
-/*partitions the ids array in two, depending on the type of sorting pretended, 
-auxiliary to the sort_tasks function*/
-int partition(int ids[], int left, int right, int type)
-{
-    int v = ids[right], i = left - 1, j = right;
-
-    while(i < j) {
-        if(type == ALPH) {
-            while (less_alph(ids[++i], v));
-            while (less_alph(v, ids[--j]))
-                if(j == left)
-                    break;
-        }
-
-        if(type == START_INST) {
-            while (less_inst(ids[++i], v));
-            while (less_inst(v, ids[--j]))
-                if(j == left)
-                    break;
-        }
-        
-        if(i < j)
-            exch(ids, i, j);
-    }
-
-    exch(ids, i, right);
-    return i;
+/*defines the functions partition_##order and sort_##order, that sort the tasks
+with ids in an array by the comparator less, each order gets its own copy of the
+sort so that the comparator is called directly and can be inlined, new orders
+only need a comparator and a DEFINE_SORT line*/
+#define DEFINE_SORT(order, less)                                              \
+int partition_##order(Board *b, int ids[], int left, int right)               \
+{                                                                             \
+    int v = ids[right], i = left - 1, j = right;                              \
+                                                                              \
+    while(i < j) {                                                            \
+        while (less(b, ids[++i], v));                                         \
+        while (less(b, v, ids[--j]))                                          \
+            if(j == left)                                                     \
+                break;                                                        \
+                                                                              \
+        if(i < j)                                                             \
+            exch(ids, i, j);                                                  \
+    }                                                                         \
+                                                                              \
+    exch(ids, i, right);                                                      \
+    return i;                                                                 \
+}                                                                             \
+                                                                              \
+void sort_##order(Board *b, int v[], int left, int right)                     \
+{                                                                             \
+    int i;                                                                    \
+                                                                              \
+    if(right <= left)                                                         \
+        return;                                                               \
+                                                                              \
+    i = partition_##order(b, v, left, right);                                 \
+                                                                              \
+    sort_##order(b, v, left, i-1);                                            \
+    sort_##order(b, v, i+1, right);                                           \
 }
 
-/*sorts the tasks with ids in the v array alphabetically or in order of start instance*/
-void sort_tasks(int v[], int left, int right, int type)
-{
-    int i;
-    
-    if(right <= left)
-        return;
-    
-    i = partition(v, left, right, type);
+/*sort_alph sorts the tasks alphabetically and sort_inst in order of start instance*/
+DEFINE_SORT(alph, less_alph)
+DEFINE_SORT(inst, less_inst)
 
-    sort_tasks(v, left, i-1, type);
-    sort_tasks(v, i+1, right, type);
+/*prints the id, activity, duration and description of the task with index i*/
+void print_task(Board *b, int i)
+{
+    fprintf(b->out, "%d %s #%d %s\n", i + 1, b->activities[b->task_activ[i]].desc, 
+                    b->task_dur[i], task_desc(b, i));
 }
 
 /*lists all existing tasks in alphabetical order*/
-void list_tasks()
+void list_tasks(Board *b)
 {
     int i;
-    int sorted[MAX_TASK]; /*array in which all tasks indexs will be stored and then sorted*/
+    int *sorted = b->scratch; /*array in which all tasks indexs will be stored and then sorted*/
 
-    for(i = 0; i < num_task; ++i)
+    for(i = 0; i < b->num_task; ++i)
         sorted[i] = i;
 
-    sort_tasks(sorted, 0, num_task - 1, ALPH); 
+    sort_alph(b, sorted, 0, b->num_task - 1); 
         
-    for(i = 0; i < num_task; ++i) {
-        printf("%d %s #%d %s\n", tasks[sorted[i]].id, tasks[sorted[i]].activ.desc, 
-                tasks[sorted[i]].dur, tasks[sorted[i]].desc);
-    }
+    for(i = 0; i < b->num_task; ++i)
+        print_task(b, sorted[i]);
 }
 
 /*executes the l command, listing all the existing tasks in alphabetical order
 or the tasks with the ids input by the user*/
-void l()
+void l(Board *b)
 {
     char c;
-    int i, id;
+    int id;
 
-    if((c = getchar()) == '\n') 
-        list_tasks();
+    if((c = getc(b->in)) == '\n') 
+        list_tasks(b);
 
     else {
         do {
-            scanf("%d", &id);
-            if((id > num_task) || (id <= 0))
-                printf("%d: no such task\n", id);
+            fscanf(b->in, "%d", &id);
+            if((id > b->num_task) || (id <= 0))
+                fprintf(b->out, "%d: no such task\n", id);
             
-            else {
-                i = id - 1;
-                printf("%d %s #%d %s\n", tasks[i].id, tasks[i].activ.desc, 
-                        tasks[i].dur, tasks[i].desc);
-            }
-        } while((c = getchar()) != '\n');
+            else
+                print_task(b, id - 1);
+        } while((c = getc(b->in)) != '\n');
     }
 }
 
 /*executes the n command, printing the current time or increasing it*/
-void n()
+void n(Board *b)
 {
     int dur;
 
-    scanf("%d", &dur);
+    fscanf(b->in, "%d", &dur);
 
     if(dur < 0) {
-        printf("invalid time\n");
+        fprintf(b->out, "invalid time\n");
         return;
     }
 
-    if(dur != 0) 
-        time += dur;
+    if(dur != 0) {
+        b->current_time += dur;
+        update_overdue(b);
+    }
 
-    printf("%d\n", time);
+    fprintf(b->out, "%d\n", b->current_time);
 }
 
 /*adds a new user to the system, auxiliary to the u function*/
-void u_new_user()
+void u_new_user(Board *b)
 {
     int i;
     User user;
     
-    scanf("%s", user.desc);
+    fscanf(b->in, "%s", user.desc);
 
-    for(i = 0; i < num_user; ++i) { /*check wether the user already exists*/
-        if(strcmp(user.desc, users[i].desc) == 0) {
-            printf("user already exists\n");
+    for(i = 0; i < b->num_user; ++i) { /*check wether the user already exists*/
+        PROFILE_EVENT(EV_SCAN_STRCMP);
+        if(strcmp(user.desc, b->users[i].desc) == 0) {
+            fprintf(b->out, "user already exists\n");
 
             return;
         }
     }
 
-    if(num_user >= MAX_USER) { 
-        printf("too many users\n");
+    if(b->num_user >= MAX_USER) { 
+        fprintf(b->out, "too many users\n");
 
         return;
     }
 
-    num_user++;
+    b->num_user++;
     
-    strcpy(users[num_user - 1].desc, user.desc);
+    strcpy(b->users[b->num_user - 1].desc, user.desc);
+    b->user_first[b->num_user - 1] = NONE;
 }
 
 /*executes the u command, listing existing users or creating a new one*/
-void u()
+void u(Board *b)
 {
     int i;
 
-    if(getchar() == '\n') {
-        for(i = 0; i < num_user; ++i)
-            printf("%s\n", users[i].desc); 
+    if(getc(b->in) == '\n') {
+        for(i = 0; i < b->num_user; ++i)
+            fprintf(b->out, "%s\n", b->users[i].desc); 
         }
                 
     else
-        u_new_user();
+        u_new_user(b);
 }
 
 /*verifies if the task with identifier id exists in the system*/
-int task_exists(int id)
-{
-    return ((0 < id) && (id <= num_task));
-}
-
-/*verifies if the user exists in the system*/
-int user_exists(User user)
+int task_exists(Board *b, int id)
 {
-    int i;
-
-    for(i = 0; i < num_user; ++i) {
-        if(strcmp(user.desc, users[i].desc) == 0)
-            return TRUE;
-    }
-    return FALSE;
+    return ((0 < id) && (id <= b->num_task));
 }
 
 /*verifies if the activity with description desc exists in the system*/
-int activ_exists(char desc[])
+int activ_exists(Board *b, char desc[])
 {
     int i;
 
-    for(i = 0; i < num_activ; ++i) {
-        if(strcmp(desc, activities[i].desc) == 0)
+    for(i = 0; i < b->num_activ; ++i) {
+        PROFILE_EVENT(EV_SCAN_STRCMP);
+        if(strcmp(desc, b->activities[i].desc) == 0)
             return TRUE;
     }
 
@@ -334,26 +955,27 @@ int activ_exists(char desc[])
 
 /*veryfies if the input following the m command is valid, 
 auxiliary to the m function*/
-int m_valid_input(int id, Activity activ, User user, Activity activ_to_do) 
+int m_valid_input(Board *b, int id, int activ, int user, int activ_to_do) 
 {
-    if(!(task_exists(id))) {
-        printf("no such task\n");
+    if(!(task_exists(b, id))) {
+        fprintf(b->out, "no such task\n");
         return INVALID;
     }
     /*return INVALID if trying to move to TO DO activity,
-    unless moving from TO DO to TO DO to change the user*/
-    if((strcmp(activ.desc, activ_to_do.desc) == 0) &&
-        !((strcmp(user.desc, tasks[id-1].user.desc) != 0) &&
-        (strcmp(tasks[id-1].activ.desc, activ_to_do.desc) == 0))) {
-        printf("task already started\n");
+    unless moving from TO DO to TO DO to change the user, a user
+    that doesn't exist is never the user of the task*/
+    if((activ == activ_to_do) &&
+        !((user == NONE || user != b->task_user[id-1]) &&
+        (b->task_activ[id-1] == activ_to_do))) {
+        fprintf(b->out, "task already started\n");
         return INVALID;
     }
-    if(!(user_exists(user))) {
-        printf("no such user\n");
+    if(user == NONE) {
+        fprintf(b->out, "no such user\n");
         return INVALID;
     }
-    if(!(activ_exists(activ.desc))) {
-        printf("no such activity\n");
+    if(activ == NONE) {
+        fprintf(b->out, "no such activity\n");
         return INVALID;
     }
     return VALID;
@@ -361,81 +983,189 @@ int m_valid_input(int id, Activity activ, User user, Activity activ_to_do)
 
 /*calculate and print slack and duration if moving to DONE,
 auxiliary to the m function*/
-void calc_slack_dur(Activity activ, Activity activ_done, Activity activ_to_do, int id)
+void calc_slack_dur(Board *b, int activ, int activ_done, int activ_to_do, int id)
 {
     int duration, slack;
     
-    if((strcmp(activ.desc, activ_done.desc) == 0) && 
-        (strcmp(tasks[id - 1].activ.desc, activ_done.desc) != 0)) {
-        if(strcmp(tasks[id - 1].activ.desc, activ_to_do.desc) == 0)
+    if((activ == activ_done) && (b->task_activ[id - 1] != activ_done)) {
+        if(b->task_activ[id - 1] == activ_to_do)
             duration = 0;
         else
-            duration = time - tasks[id - 1].start_inst;
+            duration = b->current_time - b->task_start[id - 1];
         
-        slack = duration - tasks[id - 1].dur;
-        printf("duration=%d slack=%d\n", duration, slack);
+        slack = duration - b->task_dur[id - 1];
+        if(b->slack_count == 0 || slack < b->slack_min)
+            b->slack_min = slack;
+        if(b->slack_count == 0 || slack > b->slack_max)
+            b->slack_max = slack;
+        b->slack_count++;
+        b->slack_total += slack;
+        fprintf(b->out, "duration=%d slack=%d\n", duration, slack);
     }
 }
 
 /*executes the m command, moving a task from one activity to another*/
-void m(Activity activ_done, Activity activ_to_do) 
+void m(Board *b, int activ_done, int activ_to_do) 
 {
-    int id;
+    int id, a, u, from;
     Activity activ;
     User user;
 
-    scanf("%d%s", &id, user.desc);
-    getchar(); /*space*/
+    fscanf(b->in, "%d%s", &id, user.desc);
+    getc(b->in); /*space*/
     
-    fgets(activ.desc, MAX_DESC_ACTIV, stdin);
+    fgets(activ.desc, MAX_DESC_ACTIV, b->in);
     if (activ.desc[strlen(activ.desc)-1] == '\n')
         activ.desc[strlen(activ.desc)-1] = '\0';
+    a = activ_index(b, activ.desc);
+    u = user_index(b, user.desc);
     /*return to main if the input isn't valid*/
-    if((m_valid_input(id, activ, user, activ_to_do)) != VALID) 
+    if((m_valid_input(b, id, a, u, activ_to_do)) != VALID) 
         return;
     /*change the user if moving from TO DO to TO DO with a different 
     user from the one who input the task into the system, and return*/
-    if((strcmp(user.desc, tasks[id-1].user.desc) != 0) &&
-        (strcmp(activ.desc, activ_to_do.desc) == 0)) {
-            strcpy(tasks[id - 1].user.desc, user.desc);
+    if((u != b->task_user[id-1]) && (a == activ_to_do)) {
+            change_user(b, id - 1, u);
+            log_transition(b, id - 1, activ_to_do);
             return;
         }
     /*change the task start_inst to current time if moving from TO DO*/
-    if(strcmp(tasks[id - 1].activ.desc, activ_to_do.desc) == 0)
-        tasks[id - 1].start_inst = time;
+    if(b->task_activ[id - 1] == activ_to_do)
+        b->task_start[id - 1] = b->current_time;
     
-    calc_slack_dur(activ, activ_done, activ_to_do, id);
+    calc_slack_dur(b, a, activ_done, activ_to_do, id);
 
-    strcpy(tasks[id - 1].activ.desc, activ.desc); 
-    strcpy(tasks[id - 1].user.desc, user.desc);
+    from = b->task_activ[id - 1];
+    change_activ(b, id - 1, a); 
+    change_user(b, id - 1, u);
+    update_deadline(b, id - 1, activ_to_do, activ_done);
+    log_transition(b, id - 1, from);
 }
 
 /*executes the d command, listing all the tasks in the activity input by the user*/
-void d()
+void d(Board *b)
 {
     char desc_activ[MAX_DESC_ACTIV];
-    int i, j;
-    int inds[MAX_TASK]; /*array with the index of all tasks in the input activity*/
+    int i, j, a;
+    int *inds = b->scratch; /*array with the index of all tasks in the input activity*/
 
-    getchar(); /*space*/
-    fgets(desc_activ, MAX_DESC_ACTIV, stdin);
+    getc(b->in); /*space*/
+    fgets(desc_activ, MAX_DESC_ACTIV, b->in);
     if (desc_activ[strlen(desc_activ)-1] == '\n')
         desc_activ[strlen(desc_activ)-1] = '\0';
 
-    if(!(activ_exists(desc_activ))) {
-        printf("no such activity\n");
+    if((a = activ_index(b, desc_activ)) == NONE) {
+        fprintf(b->out, "no such activity\n");
         return;
-    }        
-    for(i = 0, j = 0; i < num_task; ++i)
-        if(strcmp(desc_activ, tasks[i].activ.desc) == 0) {
-            inds[j] = tasks[i].id - 1;
-            ++j;
-        }
+    }
+    /*only the activity column is read, and without branches*/
+    for(i = 0, j = 0; i < b->num_task; ++i) {
+        inds[j] = i;
+        j += (b->task_activ[i] == a);
+    }
 
-    sort_tasks(inds, 0, j - 1, START_INST);
+    sort_inst(b, inds, 0, j - 1);
     for(i = 0; i < j; i++)
-        printf("%d %d %s\n", inds[i] + 1, tasks[inds[i]].start_inst, 
-               tasks[inds[i]].desc);                
+        fprintf(b->out, "%d %d %s\n", inds[i] + 1, b->task_start[inds[i]], 
+                        task_desc(b, inds[i]));                
+}
+
+/*executes the w command, listing in alphabetical order the tasks of the user input*/
+void w(Board *b)
+{
+    User user;
+    int i, j, u;
+    int *inds = b->scratch; /*array with the index of all tasks of the input user*/
+
+    fscanf(b->in, "%s", user.desc);
+
+    if((u = user_index(b, user.desc)) == NONE) {
+        fprintf(b->out, "no such user\n");
+        return;
+    }
+    for(i = b->user_first[u], j = 0; i != NONE; i = b->user_next[i], ++j)
+        inds[j] = i;
+
+    sort_alph(b, inds, 0, j - 1);
+    for(i = 0; i < j; i++)
+        print_task(b, inds[i]);
+}
+
+/*lists in order of duration the tasks in the subtree by duration rooted at the task
+with index i with a duration between min and max, only going down the subtrees
+that may have some of them*/
+void print_durations(Board *b, int i, int min, int max)
+{
+    if(i == NONE)
+        return;
+    if(b->task_dur[i] >= min)
+        print_durations(b, b->dur_left[i], min, max);
+    if(b->task_dur[i] >= min && b->task_dur[i] <= max)
+        print_task(b, i);
+    if(b->task_dur[i] <= max)
+        print_durations(b, b->dur_right[i], min, max);
+}
+
+/*executes the r command, listing in order of duration the tasks with a duration
+between the two input by the user*/
+void r(Board *b)
+{
+    int min, max;
+
+    fscanf(b->in, "%d%d", &min, &max);
+
+    if(min > max) {
+        fprintf(b->out, "invalid duration\n");
+        return;
+    }
+    print_durations(b, b->dur_root, min, max);
+}
+
+/*executes the o command, listing the tasks in progress that are overdue
+in the order in which they became overdue*/
+void o(Board *b)
+{
+    int i;
+
+    for(i = b->overdue_first; i != NONE; i = b->overdue_next[i])
+        fprintf(b->out, "%d %d #%d %s\n", i + 1, b->task_start[i], b->task_dur[i], 
+                task_desc(b, i));
+}
+
+/*executes the s command, printing the number of tasks and the sum of their durations
+for each activity, and the number, average, minimum and maximum of the slacks of
+the tasks moved to DONE*/
+void s(Board *b)
+{
+    int i;
+
+    for(i = 0; i < b->num_activ; ++i)
+        fprintf(b->out, "%d #%ld %s\n", b->activ_count[i], b->activ_dur[i], b->activities[i].desc);
+
+    if(b->slack_count == 0)
+        fprintf(b->out, "done=0\n");
+    else
+        fprintf(b->out, "done=%d slack=%.2f min=%d max=%d\n", b->slack_count, 
+                (double) b->slack_total / b->slack_count, b->slack_min, b->slack_max);
+}
+
+/*executes the h command, listing the tasks that existed at the end of the
+instant input by the user with the activity they were in then*/
+void h(Board *b)
+{
+    int i, time, count;
+    int *activ = b->scratch; /*activity of each task at the input time*/
+
+    fscanf(b->in, "%d", &time);
+
+    if(time < 0 || time > b->current_time) {
+        fprintf(b->out, "invalid time\n");
+        return;
+    }
+    count = board_at(b, time, activ);
+    for(i = 0; i < count; ++i)
+        fprintf(b->out, "%d %s #%d %s\n", i + 1, b->activities[activ[i]].desc, 
+                        b->task_dur[i], task_desc(b, i));
 }
 
 /*verifies whether the srting desc has any lower case letters or not*/
@@ -454,20 +1184,20 @@ int all_upper_case(char desc[])
 }
 
 /*verifies if the string desc is a valid activity description*/
-int a_valid_desc(char desc[])
+int a_valid_desc(Board *b, char desc[])
 {
-    if(activ_exists(desc)) {
-        printf("duplicate activity\n");
+    if(activ_exists(b, desc)) {
+        fprintf(b->out, "duplicate activity\n");
 
         return INVALID;
     }
     if(!(all_upper_case(desc))) {
-        printf("invalid description\n");
+        fprintf(b->out, "invalid description\n");
 
         return INVALID;
     }
-    if(num_activ >= MAX_ACTIV) {
-        printf("too many activities\n");
+    if(b->num_activ >= MAX_ACTIV) {
+        fprintf(b->out, "too many activities\n");
 
         return INVALID;
     }
@@ -475,95 +1205,752 @@ int a_valid_desc(char desc[])
 }
 
 /*adds an activity with the description desc to the system*/
-void create_activ(char desc[])
+void create_activ(Board *b, char desc[])
 {
-    if(a_valid_desc(desc) == INVALID)
+    if(a_valid_desc(b, desc) == INVALID)
         return;
 
-    strcpy(activities[num_activ].desc, desc);
+    strcpy(b->activities[b->num_activ].desc, desc);
+    b->activ_count[b->num_activ] = 0;
+    b->activ_dur[b->num_activ] = 0;
     
-    num_activ++;
+    b->num_activ++;
 }
 
 /*executes the a command, listing all activities or adding a new one to the system*/
-void a()
+void a(Board *b)
 {
     char desc_activ[MAX_DESC_ACTIV];
     int i;
 
-    if(getchar() == '\n') {
-        for(i = 0; i < num_activ; ++i)
-            printf("%s\n", activities[i].desc);
+    if(getc(b->in) == '\n') {
+        for(i = 0; i < b->num_activ; ++i)
+            fprintf(b->out, "%s\n", b->activities[i].desc);
     }
     else {
-        fgets(desc_activ, MAX_DESC_ACTIV, stdin);
+        fgets(desc_activ, MAX_DESC_ACTIV, b->in);
         if (desc_activ[strlen(desc_activ)-1] == '\n')
             desc_activ[strlen(desc_activ)-1] = '\0';
 
-        if(a_valid_desc(desc_activ) == INVALID)
+        if(a_valid_desc(b, desc_activ) == INVALID)
             return;
 
-        create_activ(desc_activ);
+        create_activ(b, desc_activ);
     }
 }
 
-/*reads user input and manipulates the management system*/
-void commands(User default_user, Activity activ_to_do, Activity activ_done)
+/*allocates the arrays of the board with room for at least INIT_TASKS tasks*/
+void alloc_board_arrays(Board *b)
 {
-    char c;
+    resize_tasks(b, b->num_task > INIT_TASKS ? b->num_task : INIT_TASKS);
+    b->pool_cap = b->pool_used + INIT_TASKS;
+    b->desc_pool = malloc(b->pool_cap);
+    b->history_cap = b->history_size > MIN_CHECKPOINT ? b->history_size : MIN_CHECKPOINT;
+    b->history = malloc(b->history_cap * sizeof(Transition));
+    b->checkpoints_cap = b->num_checkpoints > INIT_CHECKPOINTS ? 
+                         b->num_checkpoints : INIT_CHECKPOINTS;
+    b->checkpoints = malloc(b->checkpoints_cap * sizeof(Checkpoint));
+}
 
-    while((c = getchar()) != 'q') {
-        switch(c) {
-            case 't': {
-                if(num_user > 0)
-                    t(users[num_user - 1], activ_to_do);
-                else
-                    t(default_user, activ_to_do);
-                break;
-            } 
-            case 'l': {
-                l();
-                break;
-            }
-            case 'n': { 
-                n();
-                break;
-            }
-            case 'u': {
-                u();
-                break;
-            }
-            case 'm': {
-                m(activ_done, activ_to_do);
-                break;
-            }
-            case 'd': {
-                d();
-                break; 
-            }
-            case 'a': {
-                a();
-                break;
+/*frees the arrays of the board, keeping the number of elements in each one*/
+void free_board_arrays(Board *b)
+{
+    int i;
+
+    free(b->task_activ);
+    free(b->task_user);
+    free(b->task_dur);
+    free(b->task_start);
+    free(b->desc_pos);
+    free(b->user_next);
+    free(b->user_prev);
+    free(b->dur_left);
+    free(b->dur_right);
+    free(b->dur_height);
+    free(b->heap);
+    free(b->heap_pos);
+    free(b->overdue_next);
+    free(b->overdue_prev);
+    free(b->is_overdue);
+    free(b->scratch);
+    free(b->desc_pool);
+    b->task_activ = b->task_user = b->task_dur = b->task_start = b->desc_pos = NULL;
+    b->user_next = b->user_prev = b->heap = b->heap_pos = NULL;
+    b->dur_left = b->dur_right = b->dur_height = NULL;
+    b->overdue_next = b->overdue_prev = b->is_overdue = b->scratch = NULL;
+    b->desc_pool = NULL;
+    b->task_cap = b->pool_cap = 0;
+
+    for(i = 0; i < b->num_checkpoints; ++i)
+        free(b->checkpoints[i].activ);
+    free(b->checkpoints);
+    free(b->history);
+    b->checkpoints = NULL;
+    b->history = NULL;
+    b->checkpoints_cap = b->history_cap = 0;
+}
+
+/*creates a board named name with the default activities, no users and no tasks*/
+Board *mk_board(char name[])
+{
+    Board *b = calloc(1, sizeof(Board)); /*all counters at 0 and arrays at NULL*/
+
+    strcpy(b->name, name);
+    b->overdue_first = b->overdue_last = NONE;
+    b->dur_root = NONE;
+    b->snapshot = NULL;
+    b->in = stdin;
+    b->out = stdout;
+    alloc_board_arrays(b);
+
+    create_activ(b, TO_DO_DESC);
+    b->activ_to_do = b->num_activ - 1;
+    create_activ(b, IN_P_DESC);
+    create_activ(b, DONE_DESC);
+    b->activ_done = b->num_activ - 1;
+
+    if(num_boards == boards_cap) {
+        boards_cap = boards_cap == 0 ? 16 : 2 * boards_cap;
+        boards = realloc(boards, boards_cap * sizeof(Board*));
+    }
+    boards[num_boards++] = b;
+    num_loaded++;
+    return b;
+}
+
+/*writes the arrays of the board to a snapshot and frees them, the indexes that
+can be rebuilt from the others aren't written, returns FALSE if there's no
+room for the snapshot and the board stays in memory*/
+int evict_board(Board *b)
+{
+    FILE *f = tmpfile();
+    int i, count = 0;
+
+    if(f == NULL)
+        return FALSE;
+
+    fwrite(b->task_activ, sizeof(int), b->num_task, f);
+    fwrite(b->task_user, sizeof(int), b->num_task, f);
+    fwrite(b->task_dur, sizeof(int), b->num_task, f);
+    fwrite(b->task_start, sizeof(int), b->num_task, f);
+    fwrite(b->desc_pos, sizeof(int), b->num_task, f);
+    fwrite(b->heap, sizeof(int), b->heap_size, f);
+    fwrite(b->desc_pool, 1, b->pool_used, f);
+
+    for(i = b->overdue_first; i != NONE; i = b->overdue_next[i])
+        count++;
+    fwrite(&count, sizeof(int), 1, f);
+    for(i = b->overdue_first; i != NONE; i = b->overdue_next[i])
+        fwrite(&i, sizeof(int), 1, f);
+
+    fwrite(b->history, sizeof(Transition), b->history_size, f);
+    for(i = 0; i < b->num_checkpoints; ++i) {
+        fwrite(&b->checkpoints[i].pos, sizeof(int), 1, f);
+        fwrite(&b->checkpoints[i].num_task, sizeof(int), 1, f);
+        fwrite(b->checkpoints[i].activ, 1, b->checkpoints[i].num_task, f);
+    }
+
+    /*a failed write sets the error of the stream, which the flush reports*/
+    if(fflush(f) != 0 || ferror(f)) {
+        fclose(f);
+        return FALSE;
+    }
+    free_board_arrays(b);
+    b->snapshot = f;
+    num_loaded--;
+    return TRUE;
+}
+
+/*reads n elements of size bytes from f to p, returns FALSE if there were
+fewer of them*/
+int read_array(void *p, size_t size, size_t n, FILE *f)
+{
+    return fread(p, size, n, f) == n;
+}
+
+/*reads the arrays of the board back from its snapshot and rebuilds the
+user lists, the tree by duration and the positions in the heap, returns FALSE
+if the snapshot can't be read and the board stays evicted*/
+int load_board(Board *b)
+{
+    FILE *f = b->snapshot;
+    int i, count, ok;
+    Checkpoint *c;
+
+    rewind(f);
+    alloc_board_arrays(b);
+    for(i = 0; i < b->num_checkpoints; ++i)
+        b->checkpoints[i].activ = NULL;
+    ok = read_array(b->task_activ, sizeof(int), b->num_task, f) &&
+         read_array(b->task_user, sizeof(int), b->num_task, f) &&
+         read_array(b->task_dur, sizeof(int), b->num_task, f) &&
+         read_array(b->task_start, sizeof(int), b->num_task, f) &&
+         read_array(b->desc_pos, sizeof(int), b->num_task, f) &&
+         read_array(b->heap, sizeof(int), b->heap_size, f) &&
+         read_array(b->desc_pool, 1, b->pool_used, f) &&
+         read_array(&count, sizeof(int), 1, f);
+
+    if(ok) {
+        for(i = 0; i < b->num_user; ++i)
+            b->user_first[i] = NONE;
+        b->dur_root = NONE;
+        for(i = 0; i < b->num_task; ++i) {
+            link_user_task(b, i);
+            insert_by_dur(b, i);
+            b->heap_pos[i] = NONE;
+            b->is_overdue[i] = FALSE;
+        }
+        for(i = 0; i < b->heap_size; ++i)
+            b->heap_pos[b->heap[i]] = i;
+    }
+
+    b->overdue_first = b->overdue_last = NONE;
+    while(ok && count-- > 0) {
+        ok = read_array(&i, sizeof(int), 1, f) && i >= 0 && i < b->num_task;
+        if(ok)
+            append_overdue(b, i);
+    }
+
+    ok = ok && read_array(b->history, sizeof(Transition), b->history_size, f);
+    for(i = 0; ok && i < b->num_checkpoints; ++i) {
+        c = &b->checkpoints[i];
+        ok = read_array(&c->pos, sizeof(int), 1, f) &&
+             read_array(&c->num_task, sizeof(int), 1, f);
+        if(ok) {
+            c->activ = malloc(c->num_task + 1);
+            ok = read_array(c->activ, 1, c->num_task, f);
+        }
+    }
+
+    if(!ok) {
+        free_board_arrays(b);
+        return FALSE;
+    }
+    fclose(f);
+    b->snapshot = NULL;
+    num_loaded++;
+    return TRUE;
+}
+
+/*returns the board named name, creating it if it doesn't exist and loading it if
+it was evicted, then evicts the least recently used boards with no commands
+waiting while there are too many in memory, returns NULL if the board can't
+be loaded*/
+Board *select_board(char name[])
+{
+    Board *b = NULL, *lru;
+    int i;
+
+    for(i = 0; i < num_boards && b == NULL; ++i)
+        if(strcmp(name, boards[i]->name) == 0)
+            b = boards[i];
+
+    if(b == NULL)
+        b = mk_board(name);
+    else if(b->snapshot != NULL && !load_board(b))
+        return NULL;
+    b->last_used = ++board_clock;
+
+    while(num_loaded > MAX_LOADED) {
+        lru = NULL;
+        for(i = 0; i < num_boards; ++i)
+            if(boards[i] != b && boards[i]->snapshot == NULL && 
+               boards[i]->pending == 0 && (lru == NULL || boards[i]->last_used < lru->last_used))
+                lru = boards[i];
+        if(lru == NULL || !evict_board(lru))
+            break;
+    }
+    return b;
+}
+
+/*frees all boards*/
+void free_boards()
+{
+    int i;
+
+    for(i = 0; i < num_boards; ++i) {
+        if(boards[i]->snapshot != NULL)
+            fclose(boards[i]->snapshot);
+        else
+            free_board_arrays(boards[i]);
+        free(boards[i]);
+    }
+    free(boards);
+    boards = NULL;
+    num_boards = boards_cap = num_loaded = 0;
+}
+
+/*prints the names of all boards in the order they were created*/
+void list_boards(FILE *out)
+{
+    int i;
+
+    for(i = 0; i < num_boards; ++i)
+        fprintf(out, "%s\n", boards[i]->name);
+}
+
+/*executes the b command, listing all boards or selecting the board input by
+the user, which is created if it doesn't exist, returns the selected board*/
+Board *b_select(Board *b)
+{
+    char name[MAX_DESC_BOARD];
+    Board *selected;
+
+    if(getc(b->in) == '\n') {
+        list_boards(b->out);
+        return b;
+    }
+    fscanf(b->in, BOARD_FORMAT, name);
+    if((selected = select_board(name)) == NULL) {
+        fprintf(b->out, "cannot load board\n");
+        return b;
+    }
+    return selected;
+}
+
+/*executes the command c on the board b, reading its arguments from user input,
+returns the board selected after it*/
+Board *run_command(Board *b, char c)
+{
+#ifdef PROFILE
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+    switch(c) {
+        case 't': {
+            /*new tasks belong to the last user created, to none if there's no user*/
+            if(b->num_user > 0)
+                t(b, b->num_user - 1, b->activ_to_do);
+            else
+                t(b, NONE, b->activ_to_do);
+            break;
+        } 
+        case 'l': {
+            l(b);
+            break;
+        }
+        case 'n': { 
+            n(b);
+            break;
+        }
+        case 'u': {
+            u(b);
+            break;
+        }
+        case 'm': {
+            m(b, b->activ_done, b->activ_to_do);
+            break;
+        }
+        case 'd': {
+            d(b);
+            break; 
+        }
+        case 'a': {
+            a(b);
+            break;
+        }
+        case 'w': {
+            w(b);
+            break;
+        }
+        case 'r': {
+            r(b);
+            break;
+        }
+        case 'o': {
+            o(b);
+            break;
+        }
+        case 's': {
+            s(b);
+            break;
+        }
+        case 'h': {
+            h(b);
+            break;
+        }
+        case 'b': {
+            b = b_select(b);
+            break;
+        }
+#ifdef PROFILE
+        case 'p': {
+            print_profile(b->out);
+            break;
+        }
+#endif
+    }
+#ifdef PROFILE
+    profile_command(c, &start);
+#endif
+    return b;
+}
+
+#ifdef PARALLEL
+/*commands of different boards are independent, so with -DPARALLEL the main thread
+only reads the input and queues each command on its board, the boards with commands
+waiting are run by workers that take them from their own deque and steal them from
+the others when it's empty, a board is run by one worker at a time so its commands
+run in order, and the output of every command is written in the order of the input*/
+
+/*type used to store a command line of a board and, after it runs, its output*/
+typedef struct job
+{
+    char *line;
+    char *output;
+    size_t size;
+    int done;
+    struct job *next; /*next command of the same board*/
+    struct job *next_input; /*next command of the input*/
+} Job;
+
+/*type used to store the boards given to a worker, the owner takes them from the
+bottom and the other workers steal them from the top*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    Board **boards;
+    int top, size, cap; /*the boards go from position top, modulo cap*/
+#ifdef PROFILE
+    counters profile; /*counters of the worker that owns the deque*/
+#endif
+} Deque;
+
+/*type used to store the state shared by the reader, the workers and the writer,
+lock protects everything but the deques, which have their own*/
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work, written; /*signaled when there are boards to run or jobs done*/
+    pthread_cond_t room; /*signaled when a job is written*/
+    Deque deques[MAX_WORKERS];
+    int num_workers, ready; /*number of workers and of boards in the deques*/
+    Job *oldest, *newest; /*jobs not written yet, in the order of the input*/
+    long num_jobs; /*number of jobs read*/
+    int pending; /*number of jobs not written yet*/
+    int input_done;
+} Executor;
+
+Executor ex;
+
+/*adds the board b to the bottom of the deque d*/
+void push_bottom(Deque *d, Board *b)
+{
+    int i;
+    Board **boards;
+
+    pthread_mutex_lock(&d->lock);
+    if(d->size == d->cap) {
+        boards = malloc(2 * d->cap * sizeof(Board*));
+        for(i = 0; i < d->size; ++i)
+            boards[i] = d->boards[(d->top + i) % d->cap];
+        free(d->boards);
+        d->boards = boards;
+        d->top = 0;
+        d->cap *= 2;
+    }
+    d->boards[(d->top + d->size++) % d->cap] = b;
+    pthread_mutex_unlock(&d->lock);
+}
+
+/*removes a board from the bottom of the deque d if own is TRUE and from its top
+otherwise, returns NULL if it's empty*/
+Board *pop_deque(Deque *d, int own)
+{
+    Board *b = NULL;
+
+    pthread_mutex_lock(&d->lock);
+    if(d->size > 0) {
+        if(own)
+            b = d->boards[(d->top + d->size - 1) % d->cap];
+        else {
+            b = d->boards[d->top];
+            d->top = (d->top + 1) % d->cap;
+        }
+        d->size--;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return b;
+}
+
+/*runs the command line of the job on the board b, keeping its output in the job*/
+void run_job(Board *b, Job *job)
+{
+    b->in = fmemopen(job->line, strlen(job->line), "r");
+    b->out = open_memstream(&job->output, &job->size);
+    run_command(b, getc(b->in));
+    fclose(b->in);
+    fclose(b->out);
+    b->in = stdin;
+    b->out = stdout;
+}
+
+/*adds a job with line, and maybe its output, to the jobs in the order of the
+input, waiting while there are MAX_JOBS not written, must be called with ex.lock*/
+Job *add_job(char *line)
+{
+    Job *job;
+
+    while(ex.pending >= MAX_JOBS)
+        pthread_cond_wait(&ex.room, &ex.lock);
+    job = malloc(sizeof(Job));
+    job->line = line;
+    job->output = NULL;
+    job->size = 0;
+    job->done = FALSE;
+    job->next = job->next_input = NULL;
+    if(ex.newest != NULL)
+        ex.newest->next_input = job;
+    else
+        ex.oldest = job;
+    ex.newest = job;
+    ex.num_jobs++;
+    ex.pending++;
+    return job;
+}
+
+/*marks the job as done and wakes the writer, must be called with ex.lock*/
+void finish_job(Job *job)
+{
+    job->done = TRUE;
+    pthread_cond_signal(&ex.written);
+}
+
+/*runs up to BATCH commands of the board b, then gives it back to the deque d
+if it still has commands waiting*/
+void run_board(Board *b, Deque *d)
+{
+    Job *job;
+    int n;
+
+    for(n = 0; n < BATCH; ++n) {
+        pthread_mutex_lock(&ex.lock);
+        if((job = b->first_job) == NULL) {
+            b->scheduled = FALSE;
+            pthread_mutex_unlock(&ex.lock);
+            return;
+        }
+        if((b->first_job = job->next) == NULL)
+            b->last_job = NULL;
+        pthread_mutex_unlock(&ex.lock);
+
+        run_job(b, job);
+
+        pthread_mutex_lock(&ex.lock);
+        b->pending--;
+        finish_job(job);
+        pthread_mutex_unlock(&ex.lock);
+    }
+
+    pthread_mutex_lock(&ex.lock);
+    if(b->first_job == NULL)
+        b->scheduled = FALSE;
+    else {
+        push_bottom(d, b);
+        ex.ready++;
+        pthread_cond_signal(&ex.work);
+    }
+    pthread_mutex_unlock(&ex.lock);
+}
+
+/*runs boards from the deque d, or stolen from the other deques, until the input
+ends and there are no boards left*/
+void *worker(void *arg)
+{
+    Deque *d = arg;
+    Board *b;
+    int i, first = d - ex.deques;
+
+#ifdef PROFILE
+    pthread_setspecific(counters_key, &d->profile);
+#endif
+    for(;;) {
+        b = pop_deque(d, TRUE);
+        for(i = 1; b == NULL && i < ex.num_workers; ++i)
+            b = pop_deque(&ex.deques[(first + i) % ex.num_workers], FALSE);
+
+        pthread_mutex_lock(&ex.lock);
+        if(b == NULL) {
+            /*another worker may be between taking a board and counting it*/
+            if(ex.ready == 0 && ex.input_done) {
+                pthread_mutex_unlock(&ex.lock);
+                return NULL;
             }
+            if(ex.ready == 0)
+                pthread_cond_wait(&ex.work, &ex.lock);
+            pthread_mutex_unlock(&ex.lock);
+            continue;
         }
+        ex.ready--;
+        pthread_mutex_unlock(&ex.lock);
+
+        run_board(b, d);
     }
 }
 
-/*main function that initiates the default user and default activities, and calls
-the function responsible for dealing with user input and manipulating the system*/
-int main() 
-{   
-    /*used to maintain the user field empty in new tasks if no user has been created*/
-    User default_user = {"\0"}; 
-    Activity activ_to_do, activ_done;
+/*writes the output of the jobs in the order of the input as soon as they're done*/
+void *writer(void *arg)
+{
+    Job *job;
+
+    pthread_mutex_lock(&ex.lock);
+    for(;;) {
+        while((job = ex.oldest) != NULL && job->done) {
+            if((ex.oldest = job->next_input) == NULL)
+                ex.newest = NULL;
+            ex.pending--;
+            pthread_cond_signal(&ex.room);
+            pthread_mutex_unlock(&ex.lock);
+
+            if(job->output != NULL)
+                fwrite(job->output, 1, job->size, stdout);
+            free(job->output);
+            free(job->line);
+            free(job);
+            pthread_mutex_lock(&ex.lock);
+        }
+        if(ex.input_done && ex.oldest == NULL)
+            break;
+        pthread_cond_wait(&ex.written, &ex.lock);
+    }
+    pthread_mutex_unlock(&ex.lock);
+    fflush(stdout);
+    return arg;
+}
 
-    create_activ(TO_DO_DESC);
-    activ_to_do = activities[num_activ - 1];
-    create_activ(IN_P_DESC);
-    create_activ(DONE_DESC);
-    activ_done = activities[num_activ - 1];
+/*returns the next line of in, with its '\n', or NULL at the end of in*/
+char *read_line(FILE *in)
+{
+    int c, length = 0, cap = 64;
+    char *line = malloc(cap);
+
+    while((c = getc(in)) != EOF) {
+        if(length + 2 >= cap)
+            line = realloc(line, cap *= 2);
+        line[length++] = c;
+        if(c == '\n')
+            break;
+    }
+    if(length == 0) {
+        free(line);
+        return NULL;
+    }
+    line[length] = '\0';
+    return line;
+}
+
+/*queues the command line on the board b and gives the board to a worker if
+none has it*/
+void queue_command(Board *b, char *line)
+{
+    Job *job;
+
+    pthread_mutex_lock(&ex.lock);
+    job = add_job(line);
+    b->pending++;
+    if(b->last_job != NULL)
+        b->last_job->next = job;
+    else
+        b->first_job = job;
+    b->last_job = job;
+
+    if(!b->scheduled) {
+        b->scheduled = TRUE;
+        push_bottom(&ex.deques[ex.num_jobs % ex.num_workers], b);
+        ex.ready++;
+        pthread_cond_signal(&ex.work);
+    }
+    pthread_mutex_unlock(&ex.lock);
+}
+
+/*reads the input and queues each command on its board until q, the b command
+is run by the reader itself since it changes the board of the next commands*/
+void commands()
+{
+    pthread_t workers[MAX_WORKERS], writer_thread;
+    Board *b, *selected;
+    Job *job;
+    FILE *out;
+    char *line, name[MAX_DESC_BOARD];
+    int i;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    ex.num_workers = cpus < 1 ? 1 : cpus > MAX_WORKERS ? MAX_WORKERS : cpus;
+    pthread_mutex_init(&ex.lock, NULL);
+    pthread_cond_init(&ex.work, NULL);
+    pthread_cond_init(&ex.written, NULL);
+    pthread_cond_init(&ex.room, NULL);
+#ifdef PROFILE
+    pthread_key_create(&counters_key, NULL);
+    pthread_setspecific(counters_key, &totals);
+#endif
+    for(i = 0; i < ex.num_workers; ++i) {
+        pthread_mutex_init(&ex.deques[i].lock, NULL);
+        ex.deques[i].cap = 16;
+        ex.deques[i].boards = malloc(ex.deques[i].cap * sizeof(Board*));
+        pthread_create(&workers[i], NULL, worker, &ex.deques[i]);
+    }
+    pthread_create(&writer_thread, NULL, writer, NULL);
 
-    commands(default_user, activ_to_do, activ_done);
+    b = select_board(DEFAULT_BOARD);
+    while((line = read_line(stdin)) != NULL && line[0] != 'q') {
+        if(line[0] != 'b') {
+            queue_command(b, line);
+            continue;
+        }
+        /*selecting a board may evict another one, never one with commands waiting*/
+        pthread_mutex_lock(&ex.lock);
+        job = add_job(line);
+        out = open_memstream(&job->output, &job->size);
+        if(sscanf(line + 1, BOARD_FORMAT, name) < 1)
+            list_boards(out);
+        else if((selected = select_board(name)) != NULL)
+            b = selected;
+        else
+            fprintf(out, "cannot load board\n");
+        fclose(out);
+        finish_job(job);
+        pthread_mutex_unlock(&ex.lock);
+    }
+    free(line);
+
+    pthread_mutex_lock(&ex.lock);
+    ex.input_done = TRUE;
+    pthread_cond_broadcast(&ex.work);
+    pthread_cond_broadcast(&ex.written);
+    pthread_mutex_unlock(&ex.lock);
+    for(i = 0; i < ex.num_workers; ++i) {
+        pthread_join(workers[i], NULL);
+        free(ex.deques[i].boards);
+#ifdef PROFILE
+        add_counters(&ex.deques[i].profile);
+#endif
+    }
+    pthread_join(writer_thread, NULL);
+}
+#else
+/*reads user input and manipulates the management system, starting on the default board*/
+void commands()
+{
+    Board *b = select_board(DEFAULT_BOARD);
+    char c;
+
+    while((c = getc(b->in)) != 'q')
+        b = run_command(b, c);
+}
+#endif
+
+/*main function that calls the function responsible for dealing with user input
+and manipulating the system, the boards are created with their default activities
+when they're first selected*/
+int main() 
+{   
+    commands();
+    free_boards();
+#ifdef PROFILE
+    print_profile(stderr);
+#endif
     
     return 0;
 }
\ No newline at end of file
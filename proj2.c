@@ -2,12 +2,40 @@
  * File: proj2.c
  * Author: Sofia Pinho
  * Description: A programme that creates and manages a hierarchical storage system
- * similar to a file system.
+ * similar to a file system, through text commands run on the store of store.c.
+ *
+ * Build: gcc -Wall -Wextra -ansi -pedantic -o proj2 proj2.c store.c
 */
 
+#if defined(SERVER)
+#define _POSIX_C_SOURCE 200809L /* sockets, fmemopen and open_memstream */
+#elif defined(PROFILE)
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include "store.h"
+#ifdef PROFILE
+#include <time.h>
+#endif
+#ifdef SERVER
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define MAX_EVENTS    64 /* events handled in each wait of the event loop */
+#define READ_SIZE     4096 /* bytes read from a client at a time */
+#define MAX_PENDING   (1 << 20) /* output of a client above which its commands
+                                   wait and the changes it watches are lost */
+#define PRINT_BATCH   256 /* paths printed at a time by a long print of a client */
+#define LOST          "lost" /* line with the number of changes a client lost */
+#define MAX_LOST      32 /* chars of that line */
+#endif
 
 #define MAX_CHAR_INST 65535
 /* comands descriptions */
@@ -19,959 +47,1064 @@
 #define LIST_DESC     "list: Lista todos os componentes imediatos de um sub-caminho."
 #define SEARCH_DESC   "search: Procura o caminho dado um valor."
 #define DELETE_DESC   "delete: Apaga um caminho e todos os subcaminhos."
+#define PRINTPAGE_DESC "printpage: Imprime uma página de caminhos e valores a partir de um cursor."
+#define LISTPAGE_DESC "listpage: Lista uma página de componentes imediatos a partir de um cursor."
+#define SCAN_DESC     "scan: Imprime os subcaminhos de um caminho e os seus valores."
+#define STATS_DESC    "stats: Imprime o número de subcaminhos e o tamanho dos valores de um caminho."
+#define MOVE_DESC     "move: Move um caminho e todos os subcaminhos para outro caminho."
+#define CLONE_DESC    "clone: Copia um caminho e todos os subcaminhos para outro caminho."
+#define BEGIN_DESC    "begin: Inicia uma transação de comandos set e delete."
+#define COMMIT_DESC   "commit: Aplica de uma só vez os comandos da transação."
+#define ABORT_DESC    "abort: Descarta os comandos da transação."
+#define BUDGET_DESC   "budget: Limita a memória, guardando em disco os caminhos usados há mais tempo."
+#define WATCH_DESC    "watch: Imprime as mudanças dos valores de um caminho e dos subcaminhos."
+#define UNWATCH_DESC  "unwatch: Deixa de imprimir as mudanças dos valores de um caminho."
+#define STARTSWITH_DESC "startswith: Imprime os caminhos cujo valor começa por um texto."
+#define CONTAINS_DESC "contains: Imprime os caminhos cujo valor contém um texto."
 /* errors */
 #define NOT_FOUND     "not found"
 #define NO_DATA       "no data"
+#define INVALID_COUNT "invalid count"
+#define INVALID_DEPTH "invalid depth"
+#define INVALID_MOVE  "invalid move"
+#define INVALID_CLONE "invalid clone"
+#define EXISTS        "already exists"
+#define NO_TRANSACTION "no transaction"
+#define IN_TRANSACTION "transaction already begun"
+#define INVALID_BUDGET "invalid budget"
+/* pages */
+#define CURSOR_END    "end"
 /* boolean values */
 #define TRUE          1
 #define FALSE         0
-/* structs and prototypes */
-/* a doubly linked list that stores chars */
-typedef struct strnode {
-    struct strnode *next, *previous;
-    char c;
-} str_node;
-
-typedef struct {
-    struct strnode *head, *last;
-} string;
 
-string* mk_string();
-void free_string(string *s);
-void add_last_string(string *l, char c);
-void remove_last_string(string *l);
-void remove_first_string(string *l);
-int stringcmp(string *s1, string *s2);
-void stringcopy(string *s1, string *s2);
-void print_str(string *s);
-int len(string *s);
-string* remove_directory(string *s1, string *s2);
+/* profiling of commands and of the events that dominate their cost, compiled
+in only with -DPROFILE so that it costs nothing otherwise */
+#ifdef PROFILE
+#define NUM_BUCKETS   32 /* bucket i counts latencies below 2^i microseconds */
+#define NUM_PROFILED  22
 
-/* returns a new empty string */
-string* mk_string()
+/* the calls, total time and latency histogram of a command */
+typedef struct {
+    unsigned long calls;
+    double total;
+    unsigned long histogram[NUM_BUCKETS];
+} command_profile;
+
+const char *profiled_names[NUM_PROFILED] = {"help", "set", "print", "find",
+    "list", "search", "delete", "printpage", "listpage", "scan", "stats",
+    "move", "clone", "begin", "commit", "abort", "budget", "watch", "unwatch",
+    "startswith", "contains", "profile"};
+command_profile profiles[NUM_PROFILED];
+
+/* adds the time elapsed since start to the profile of the command */
+void profile_command(char command[], struct timespec *start)
 {
-    string *new_string = malloc(sizeof(string));
-
-    new_string->head = NULL;
-    new_string->last = NULL;
-
-    return new_string;
+    struct timespec now;
+    double latency;
+    int i, bucket;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    latency = (now.tv_sec - start->tv_sec) * 1e6 +
+              (now.tv_nsec - start->tv_nsec) / 1e3;
+
+    for(i = 0; i < NUM_PROFILED; i++) {
+        if(strcmp(command, profiled_names[i]) == 0) {
+            for(bucket = 0; bucket < NUM_BUCKETS - 1 &&
+                latency >= (1L << bucket); bucket++);
+            profiles[i].calls++;
+            profiles[i].total += latency;
+            profiles[i].histogram[bucket]++;
+            return;
+        }
+    }
 }
 
-/* frees all memory associated with the string s */
-void free_string(string *s)
+/* prints the profile of every command that was called and the event counters */
+void print_profile(FILE *out)
 {
-    if(s == NULL) {
-        free(s);
-        return;
-    }
-    while(s->head != NULL) {
-        str_node *next = s->head->next;
-        free(s->head);
-        s->head = next;
+    int i, j;
+
+    fprintf(out, "%-10s %10s %12s %10s  %s\n", "command", "calls",
+            "total(us)", "mean(us)", "histogram (us)");
+    for(i = 0; i < NUM_PROFILED; i++) {
+        if(profiles[i].calls == 0)
+            continue;
+        fprintf(out, "%-10s %10lu %12.1f %10.2f ", profiled_names[i],
+                profiles[i].calls, profiles[i].total,
+                profiles[i].total / profiles[i].calls);
+        for(j = 0; j < NUM_BUCKETS; j++)
+            if(profiles[i].histogram[j] != 0)
+                fprintf(out, " <%ld:%lu", 1L << j, profiles[i].histogram[j]);
+        fprintf(out, "\n");
     }
-    free(s);
+    for(i = 0; i < NUM_EVENTS; i++)
+        fprintf(out, "%s=%lu%c", event_names[i], profile_events[i],
+                i == NUM_EVENTS - 1 ? '\n' : ' ');
 }
+#endif
 
-/* adds the char c to the string s */
-void add_last_string(string *s, char c)
-{
-    str_node *new_node = malloc(sizeof(str_node));
+/* the streams commands read their arguments from and write their output to,
+stdin and stdout unless the server is running the commands of a client */
+FILE *in, *out;
 
-    new_node->c = c;
-    new_node->previous = s->last;
-    new_node->next = NULL;
-    
-    if(s->last != NULL) 
-        s->last->next = new_node;
-  
-    else
-        s->head = new_node;
+/* the transaction begun by whoever runs a command, NULL if there's none,
+which keeps the sets and deletes it runs until they're committed */
+store_txn *transaction = NULL;
 
-    s->last = new_node;
-}
+/* whoever runs a command, as the subscriber that watches paths,
+NULL unless it's a client of the server */
+void *subscriber = NULL;
 
-/* removes the last char from the string s */
-void remove_last_string(string *s)
+/* prints all available comands and their descriptions */
+void help()
 {
-    str_node *last = s->last;
+    fprintf(out, "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n"
+    "%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n",
+    HELP_DESC, QUIT_DESC, SET_DESC, PRINT_DESC, FIND_DESC, LIST_DESC,
+    SEARCH_DESC, DELETE_DESC, PRINTPAGE_DESC, LISTPAGE_DESC, SCAN_DESC,
+    STATS_DESC, MOVE_DESC, CLONE_DESC, BEGIN_DESC, COMMIT_DESC, ABORT_DESC,
+    BUDGET_DESC, WATCH_DESC, UNWATCH_DESC, STARTSWITH_DESC, CONTAINS_DESC);
+}
 
-    if(s->head->next != NULL) {
-        s->last = last->previous;
-        s->last->next = NULL;
-    }
+/* reads from input a path, up to a space, a tab or the end of the line, into
+path and returns its length, storing in end the char that ended it */
+int read_path(char path[], int *end)
+{
+    int c, length = 0;
 
-    else {
-        s->head = NULL;
-        s->last = NULL;
+    while((c = getc(in)) != ' ' && c != '\t' && c != '\n' && c != EOF) {
+        if(length < MAX_CHAR_INST)
+            path[length++] = c;
     }
-
-    free(last);
+    *end = c;
+    return length;
 }
 
-/* removes the first char from the string s */
-void remove_first_string(string *s)
+/* reads from input a value, up to the end of the line, into value
+and returns its length */
+int read_value(char value[])
 {
-    str_node *first = s->head;
+    int c, length = 0;
 
-    if(s->head->next != NULL) {
-        s->head = first->next;
-        s->head->previous = NULL;
-    }
-
-    else {
-        s->head = NULL;
-        s->last = NULL;
+    while((c = getc(in)) != '\n' && c != EOF) {
+        if(length < MAX_CHAR_INST)
+            value[length++] = c;
     }
+    return length;
+}
 
-    free(first);
+/* prints the cursor path from which the next page starts,
+or the end mark if there's no next page */
+void print_cursor(const char *path, size_t length)
+{
+    fprintf(out, "cursor ");
+    if(path != NULL)
+        fwrite(path, 1, length, out);
+    else
+        fprintf(out, "%s", CURSOR_END);
+    fprintf(out, "\n");
 }
 
-/* compares the strings s1 and s2, returns 0 if they're equal, a negative
-value if s2 comes after alphabetically and a positive value if the
-opposite is true */
-int stringcmp(string *s1, string *s2)
+/* prints up to count paths of the iteration it (all of them if count is
+negative) with their values, or only their last directory if names is TRUE,
+and then the cursor of the next page if cursor is TRUE, returns FALSE if
+the iteration is over */
+int print_from(store_iter *it, int count, int names, int cursor)
 {
-    str_node *c1 = s1->head;
-    str_node *c2 = s2->head;
-    int res;
-    
-    while(c1->c == c2->c) {
-        if(c1 == s1->last && c2 != s2->last) {
-            res = '\0' - c2->next->c;
-            return res;
+    const char *path, *value;
+    size_t path_length, value_length, last;
+    int more = TRUE;
+
+    for(; count != 0 &&
+          (more = store_next(it, &path, &path_length, &value, &value_length));
+        count--) {
+        if(names) {
+            for(last = path_length; path[last - 1] != '/'; last--);
+            fwrite(path + last, 1, path_length - last, out);
         }
-        if(c2 == s2->last && c1 != s1->last) {
-            res = c1->next->c - '\0';
-            return res;
+        else {
+            fwrite(path, 1, path_length, out);
+            fprintf(out, " ");
+            fwrite(value, 1, value_length, out);
         }
-        if(c1 == s1->last && c2 == s2->last)
-            return 0;
-
-        c1 = c1->next;
-        c2 = c2->next;
-    } 
-    res = c1->c - c2->c;
-    
-    return res;
+        fprintf(out, "\n");
+        if(count < 0)
+            count++; /* so that it never reaches 0 */
+    }
+    if(cursor && more &&
+       store_next(it, &path, &path_length, &value, &value_length))
+        print_cursor(path, path_length);
+    else if(cursor)
+        print_cursor(NULL, 0);
+    return more;
 }
 
-/* copies the content of the string s1 to the string s2 */
-void stringcopy(string *s1, string *s2)
-{
-    str_node *c = s1->head;
+#ifdef SERVER
+/* an iteration that a client prints in batches, so that the commands of the
+other clients run in between, which it doesn't see since it keeps its snapshot
+of the store, names as in print_from */
+typedef struct {
+    store_iter *it;
+    int names;
+} batch;
 
-    for(;c != NULL; c = c->next)
-        add_last_string(s2, c->c);
-}
+batch *batched = NULL; /* where the client running a command takes its prints */
+#endif
 
-/* prints the string s */
-void print_str(string *s)
+/* prints all paths of the iteration it, as print_from, and frees it, unless
+a client of the server takes it over to print it in batches */
+void print_all(store_iter *it, int names)
 {
-    str_node *c = s->head;
-
-    while(c != NULL) {
-        putchar(c->c);
-        c = c->next;
+#ifdef SERVER
+    if(batched != NULL) {
+        batched->it = it;
+        batched->names = names;
+        return;
     }
+#endif
+    print_from(it, -1, names, FALSE);
+    store_iter_free(it);
 }
 
-/* returns the length of the string s */
-int len(string *s)
+/* adds or modifies a value */
+void set(store *s)
 {
-    str_node *c;
-    int count = 1;
-
-    if(s == NULL)
-        return 0;
-    
-    c = s->head;
-
-    for(; c != NULL; c = c->next, count++);
+    static char path[MAX_CHAR_INST], value[MAX_CHAR_INST];
+    int end, path_length = read_path(path, &end);
 
-    return count;
+    if(transaction != NULL)
+        store_txn_set(transaction, path, path_length, value,
+                      read_value(value));
+    else
+        store_set(s, path, path_length, value, read_value(value));
 }
 
-/* returns the string equivalent to s2 without s1 in the beginning,
-returns NULL if s1 and s2 are equal or if s2 doesn't start with s1*/
-string* remove_directory(string *s1, string *s2)
+/* prints all paths and values */
+void print(store *s)
 {
-    string *new;
-    str_node *c1;
-    str_node *c2 = s2->head;
-    
-    if(s1 == NULL) {
-        new = mk_string();
-        stringcopy(s2, new);
-        return(new);
-    }
-    c1 = s1->head;
-
-    if(stringcmp(s1, s2) == 0)
-        return NULL;
-    
-    for(;c1 != NULL; c1 = c1->next, c2 = c2->next) {
-        if(c1->c != c2->c) 
-            return NULL;
-    }
-    new = mk_string();
-
-    for(;c2 != NULL; c2 = c2->next)
-        add_last_string(new, c2->c);
-    
-    return new;
+    print_all(store_walk(s, NULL, 0), FALSE);
 }
 
-/* a struct which stores the pointers to the strings that represent a path, desc,
-and its value, value */
-typedef struct {
-    string *desc;
-    string *value;
-} Path;
-
-Path* mk_path(string *desc, string *value);
-string* read_path_desc();
-string* read_path_value();
-string* mother_path(string *desc);
-string* n_dir(string *desc, int n);
-string* sub_dir(string *desc, string *desc_remove);
-int number_subpaths(string *desc);
-void free_path(Path *path);
-
-/* makes a new path */
-Path* mk_path(string *desc, string *value)
+/* prints a page of paths and values, of the size given in the input, in the
+same order as print, starting at the path given as cursor or at the first path
+if there's none, each page costs time proportional to its size */
+void print_page(store *s)
 {
-    Path *new_path = malloc(sizeof(Path));
-
-    new_path->desc = desc;
-    new_path->value = value;
-    
-    return new_path;
+    static char cursor[MAX_CHAR_INST];
+    store_iter *it;
+    int count, end, length = 0;
+
+    fscanf(in, "%d", &count);
+    if(getc(in) != '\n')
+        length = read_path(cursor, &end);
+
+    if(count <= 0)
+        fprintf(out, "%s\n", INVALID_COUNT);
+    else if((it = store_walk(s, cursor, length)) == NULL)
+        fprintf(out, "%s\n", NOT_FOUND);
+    else {
+        print_from(it, count, FALSE, TRUE);
+        store_iter_free(it);
+    }
 }
 
-/* reads input and creates a new string that follows path descriptions rules */
-string* read_path_desc()
+/* prints the value stored in a path */
+void find(store *s)
 {
-    char c;
-    string *desc = mk_string();
-    add_last_string(desc, '/');
-
-    while((c = getchar()) != ' ' && c != '\t' && c != '\n') {
-        if(c == '/' && desc->last->c == '/')
-            continue;
-
-        add_last_string(desc, c);
+    static char path[MAX_CHAR_INST];
+    const char *value;
+    size_t value_length;
+    int end, length = read_path(path, &end);
+
+    switch(store_get(s, path, length, &value, &value_length)) {
+        case STORE_OK:
+            fwrite(value, 1, value_length, out);
+            fprintf(out, "\n");
+            break;
+        case STORE_NO_DATA:
+            fprintf(out, "%s\n", NO_DATA);
+            break;
+        default:
+            fprintf(out, "%s\n", NOT_FOUND);
     }
-
-    if(desc->last->c == '/') 
-        remove_last_string(desc);
-
-    return desc;
 }
 
-/* reads input and creates a new string that follows value rules */
-string* read_path_value()
+/* lists all components of the directory given in the input,
+or of the root if there's none */
+void list(store *s)
 {
-    char c;
-    string *value = mk_string();
+    static char dir[MAX_CHAR_INST];
+    store_iter *it;
+    int end, length = 0;
 
-    while((c = getchar()) != '\n')
-        add_last_string(value, c);
+    if(getc(in) != '\n')
+        length = read_path(dir, &end);
 
-    return value;
+    if((it = store_list(s, dir, length, NULL, 0)) == NULL)
+        fprintf(out, "%s\n", NOT_FOUND);
+    else
+        print_all(it, TRUE);
 }
 
-/* returns the string equivalent to the description of the path that has the 
-path with description desc as a direct subpath */
-string* mother_path(string *desc)
+/* lists a page of the components of a directory, of the size given in the
+input, starting at the component given as cursor or at the first one */
+void list_page(store *s)
 {
-    string *new_path_desc = mk_string();
-    str_node *c;
-    stringcopy(desc, new_path_desc);
-    
-    c = new_path_desc->last;
-
-    while(c->c != '/') {
-        c = c->previous;
-        remove_last_string(new_path_desc);
+    static char dir[MAX_CHAR_INST], cursor[MAX_CHAR_INST];
+    store_iter *it;
+    int count, end, dir_length, cursor_length = 0;
+
+    fscanf(in, "%d", &count);
+    getc(in); /* space */
+    dir_length = read_path(dir, &end);
+    if(end != '\n')
+        cursor_length = read_path(cursor, &end);
+
+    if(count <= 0)
+        fprintf(out, "%s\n", INVALID_COUNT);
+    else if((it = store_list(s, dir, dir_length, cursor,
+                             cursor_length)) == NULL)
+        fprintf(out, "%s\n", NOT_FOUND);
+    else {
+        print_from(it, count, TRUE, TRUE);
+        store_iter_free(it);
     }
-    remove_last_string(new_path_desc);
-
-    return new_path_desc;
 }
 
-/* returns the subdirectory number n of the directory desc, if
-desc doesn't have enough subdirs or n = 0 returns NULL */
-string* n_dir(string *desc, int n)
+/* prints all subpaths of a path and their values, optionally only those up
+to a given depth below it and that match a glob pattern */
+void scan(store *s)
 {
-    string *new;
-    str_node *c = desc->head;
-
-    if(n == 0)
-        return NULL;
-    
-    if(number_subpaths(desc) < n)
-        return NULL;
-
-    new = mk_string();
-
-    for(; n != 0; n--) {
-        add_last_string(new, c->c);
-        c = c->next;
-
-        for(; c != NULL && c->c != '/'; c = c->next) 
-            add_last_string(new, c->c);   
-    }
-    return new;
-}
-
-/* returns the string equivalent to the name of the direct subdirectory 
-of the directory desc_remove in the path desc */
-string* sub_dir(string *desc, string *desc_remove) {
-    string *aux = remove_directory(desc_remove, desc);
-    string *new;
-    str_node *c;
-    
-    if(aux == NULL) {
-        free(aux);
-        return NULL;
+    static char dir[MAX_CHAR_INST], pattern[MAX_CHAR_INST];
+    store_iter *it;
+    int depth = 0, end, c, dir_length, pattern_length = 0;
+
+    dir_length = read_path(dir, &end);
+    if(end != '\n') {
+        fscanf(in, "%d", &depth);
+        if((c = getc(in)) != '\n' && c != EOF)
+            pattern_length = read_path(pattern, &end);
     }
-    
-    new = mk_string();
-    c = aux->head->next;
-
-    for(; c != NULL && c->c != '/'; c = c->next)
-        add_last_string(new, c->c);
-
-    free_string(aux);
-    
-    return new;
+    if(depth < 0)
+        fprintf(out, "%s\n", INVALID_DEPTH);
+    else if((it = store_scan(s, dir, dir_length, depth, pattern,
+                             pattern_length)) == NULL)
+        fprintf(out, "%s\n", NOT_FOUND);
+    else
+        print_all(it, FALSE);
 }
 
-/* returns the number of subpaths in the description desc */
-int number_subpaths(string *desc)
+/* searchs for a path through its value */
+void search(store *s)
 {
-    string *new_path_desc = mk_string();
-    string *mother_path_desc;
-    int count = 0;
-
-    stringcopy(desc, new_path_desc);
-
-    while(new_path_desc->head != NULL) {
-        count++;
-        mother_path_desc = mother_path(new_path_desc);
-        free_string(new_path_desc);
-        new_path_desc = mother_path_desc;
+    static char value[MAX_CHAR_INST];
+    store_iter *it = store_search(s, value, read_value(value));
+    const char *path, *found;
+    size_t path_length, found_length;
+
+    if(store_next(it, &path, &path_length, &found, &found_length)) {
+        fwrite(path, 1, path_length, out);
+        fprintf(out, "\n");
     }
-    free_string(mother_path_desc);
-
-    return count;
+    else
+        fprintf(out, "%s\n", NOT_FOUND);
+    store_iter_free(it);
 }
 
-/* frees all memory associated with the Path path */
-void free_path(Path *path)
+/* prints the paths whose values start with, or contain if contains is TRUE,
+the text given in the input, with their values, in the same order as print */
+void search_values(store *s, int contains)
 {
-    free_string(path->desc);
+    static char part[MAX_CHAR_INST];
+    int length = read_value(part);
+    store_iter *it = contains ? store_search_substring(s, part, length)
+                              : store_search_prefix(s, part, length);
+    const char *path, *value;
+    size_t path_length, value_length;
+
+    if(!store_next(it, &path, &path_length, &value, &value_length)) {
+        fprintf(out, "%s\n", NOT_FOUND);
+        store_iter_free(it);
+        return;
+    }
+    fwrite(path, 1, path_length, out);
+    fprintf(out, " ");
+    fwrite(value, 1, value_length, out);
+    fprintf(out, "\n");
+    print_all(it, FALSE);
+}
 
-    if(path->value != NULL)
-        free_string(path->value);
+/* prints the number of subpaths and the total size of the values of a path,
+or of the whole store and the memory it uses if no path is given */
+void stats(store *s)
+{
+    static char path[MAX_CHAR_INST];
+    store_info info;
+    int end, length = 0;
+
+    if(getc(in) != '\n')
+        length = read_path(path, &end);
+
+    if(store_stats(s, path, length, &info) != STORE_OK)
+        fprintf(out, "%s\n", NOT_FOUND);
+    else if(!store_is_root(path, length))
+        fprintf(out, "subpaths=%ld bytes=%ld\n", info.subpaths, info.bytes);
+    else if(info.budget == 0)
+        fprintf(out, "subpaths=%ld bytes=%ld keys=%ld values=%ld index=%ld\n",
+                info.subpaths, info.bytes, info.keys, info.values, info.index);
     else
-        free(path->value);
-    
-    free(path);
+        fprintf(out, "subpaths=%ld bytes=%ld keys=%ld values=%ld index=%ld "
+                "budget=%ld hits=%ld misses=%ld spills=%ld\n",
+                info.subpaths, info.bytes, info.keys, info.values, info.index,
+                info.budget, info.hits, info.misses, info.spills);
 }
 
-/* an AVL tree that stores pointers to all existing paths in alphabetical order */
-typedef struct treenode {
-    Path *path;
-    struct treenode *left;
-    struct treenode *right;
-    int height;
-} *tree;
-
-int less(string *desc1, string *desc2);
-int equal(string *desc1, string *desc2);
-tree new_h(Path *path, tree left, tree right);
-tree search_tree(tree h, string *desc);
-tree insert(tree h, Path *path);
-tree max(tree h);
-tree min(tree h);
-tree delete_tree(tree h, string *desc);
-void free_tree(tree h);
-
-/* returns TRUE if desc1 comes after than desc2 alphabetically
-and FALSE otherwise */
-int less(string *desc1, string *desc2)
+/* limits the memory of the store to the number of bytes given in the input,
+or lifts the limit if it's 0 */
+void budget(store *s)
 {
-    return stringcmp(desc1, desc2) > 0;
+    long bytes = -1;
+
+    fscanf(in, "%ld", &bytes);
+    if(bytes < 0)
+        fprintf(out, "%s\n", INVALID_BUDGET);
+    else
+        store_set_budget(s, bytes);
 }
 
-/* returns TRUE if the strings desc1 and desc2 are equal
-and FALSE otherwise */
-int equal(string *desc1, string *desc2)
+/* deletes a path and all its subpaths, or every path if none is given */
+void delete(store *s)
 {
-    if(desc1 == NULL || desc2 == NULL)
-        return FALSE;
-    if(desc1->head == NULL)
-        return FALSE;
-    if(desc2->head == NULL)
-        return FALSE;
-    
-    return stringcmp(desc1, desc2) == 0;
+    static char path[MAX_CHAR_INST];
+    int end, all = getc(in) == '\n', path_length = 0;
+
+    if(!all)
+        path_length = read_path(path, &end);
+    if(!all && store_is_root(path, path_length))
+        fprintf(out, "%s\n", NOT_FOUND);
+    else if(transaction != NULL)
+        store_txn_delete(transaction, path, path_length);
+    else if(all)
+        store_clear(s);
+    else if(store_delete(s, path, path_length) != STORE_OK)
+        fprintf(out, "%s\n", NOT_FOUND);
 }
 
-/* creates and returns a new tree with the trees left and 
-right in their respective position */
-tree new_h(Path *path, tree left, tree right)
+/* moves a path and all its subpaths to another path, which only relinks the
+path, or, if clone is TRUE, copies them there, sharing them until either copy
+is changed, whatever the number of its subpaths */
+void move(store *s, int clone)
 {
-    tree new = malloc(sizeof(struct treenode));
-
-    new->path = path;
-    new->left = left;
-    new->right = right;
-    new->height = 1;
-
-    return new;
+    static char from[MAX_CHAR_INST], to[MAX_CHAR_INST];
+    int end, from_length = read_path(from, &end), to_length = 0;
+
+    if(end != '\n')
+        to_length = read_path(to, &end);
+
+    switch(clone ? store_clone(s, from, from_length, to, to_length)
+                 : store_move(s, from, from_length, to, to_length)) {
+        case STORE_OK:
+            break;
+        case STORE_NOT_FOUND:
+            fprintf(out, "%s\n", NOT_FOUND);
+            break;
+        case STORE_EXISTS:
+            fprintf(out, "%s\n", EXISTS);
+            break;
+        default:
+            fprintf(out, "%s\n", clone ? INVALID_CLONE : INVALID_MOVE);
+    }
 }
 
-/* returns the height of the tree h */
-int height(tree h)
+/* prints the change of the value of a path, with the old value and the new
+one in lines of their own unless the path had none or has none anymore */
+void print_change(const char *path, size_t path_length,
+                  const char *old_value, size_t old_length,
+                  const char *new_value, size_t new_length)
 {
-    if(h == NULL)
-        return 0;
-    return h->height;
+    fprintf(out, "change ");
+    fwrite(path, 1, path_length, out);
+    fprintf(out, "\n");
+    if(old_value != NULL) {
+        fprintf(out, "old ");
+        fwrite(old_value, 1, old_length, out);
+        fprintf(out, "\n");
+    }
+    if(new_value != NULL) {
+        fprintf(out, "new ");
+        fwrite(new_value, 1, new_length, out);
+        fprintf(out, "\n");
+    }
 }
 
-/* rotation of tree h to the left */
-tree rotL(tree h)
+#ifdef SERVER
+/* gives the change of the value of a path to the client that watches it,
+defined with the server */
+void notify(void *watcher, const char *path, size_t path_length,
+            const char *old_value, size_t old_length,
+            const char *new_value, size_t new_length);
+#else
+/* prints the change of the value of a path that whoever runs
+the commands watches */
+void notify(void *watcher, const char *path, size_t path_length,
+            const char *old_value, size_t old_length,
+            const char *new_value, size_t new_length)
 {
-    int hleft, hright, xleft, xright;
-    tree x = h->right;
-    h->right = x->left;
-    x->left = h;
-
-    hleft = height(h->left);
-    hright = height(h->right);
-    h->height = hleft > hright ? hleft + 1: hright + 1;
-
-    xleft = height(x->left);
-    xright = height(x->right);
-    x->height = xleft > xright ? xleft + 1: xright + 1;
-
-    return x;
+    (void) watcher;
+    print_change(path, path_length, old_value, old_length, new_value,
+                 new_length);
 }
+#endif
 
-/* rotation of tree h to the right */
-tree rotR(tree h)
+/* watches the path given in the input, or the root if there's none, printing
+the changes of its value and of the values of its subpaths as they're made */
+void watch(store *s)
 {
-    int hleft, hright, xleft, xright;
-    tree x = h->left;
-    h->left = x->right;
-    x->right = h;
+    static char path[MAX_CHAR_INST];
+    int end, length = 0;
 
-    hleft = height(h->left);
-    hright = height(h->right);
-    h->height = hleft > hright ? hleft + 1: hright + 1;
-
-    xleft = height(x->left);
-    xright = height(x->right);
-    x->height = xleft > xright ? xleft + 1: xright + 1;
-
-    return x;
+    if(getc(in) != '\n')
+        length = read_path(path, &end);
+    store_watch(s, path, length, notify, subscriber);
 }
 
-/* double rotation to the left and right */
-tree rotLR(tree h)
+/* stops watching the path given in the input, or the root if there's none */
+void unwatch(store *s)
 {
-    if(h == NULL)
-        return h;
-    h->left = rotL(h->left);
-    return rotR(h);
-}
+    static char path[MAX_CHAR_INST];
+    int end, length = 0;
 
-/* double rotation to the right and left */
-tree rotRL(tree h)
-{
-    if(h == NULL)
-        return h;
-    h->right = rotR(h->right);
-    return rotL(h);
+    if(getc(in) != '\n')
+        length = read_path(path, &end);
+    if(store_unwatch(s, path, length, subscriber) != STORE_OK)
+        fprintf(out, "%s\n", NOT_FOUND);
 }
 
-/* balance factor */
-int balance(tree h)
+/* begins a transaction, whose sets and deletes only change the store
+once it's committed */
+void begin()
 {
-    if(h == NULL)
-        return 0;
-    return height(h->left) - height(h->right);
+    if(transaction != NULL)
+        fprintf(out, "%s\n", IN_TRANSACTION);
+    else
+        transaction = store_begin();
 }
 
-/* balances the tree */
-tree AVLbalance(tree h)
+/* applies the sets and deletes of the transaction at once, printing what
+its deletes would have printed */
+void commit(store *s)
 {
-    int balance_factor, hleft, hright;
-
-    if(h == NULL)
-        return h;
-    balance_factor = balance(h);
+    int missing;
 
-    if(balance_factor > 1) {
-        if(balance(h->left) >= 0)
-            h = rotR(h);
-        else
-            h = rotLR(h);
-    }
-    else if(balance_factor < -1) {
-        if(balance(h->right) <= 0)
-            h = rotL(h);
-        else
-            h = rotRL(h);
-    }
-    else {
-        hleft = height(h->left);
-        hright = height(h->right);
-        h->height = hleft > hright ? hleft + 1: hright + 1;
+    if(transaction == NULL) {
+        fprintf(out, "%s\n", NO_TRANSACTION);
+        return;
     }
-    return h;
+    for(missing = store_commit(s, transaction); missing > 0; missing--)
+        fprintf(out, "%s\n", NOT_FOUND);
+    transaction = NULL;
 }
 
-/* searchs for the Path with description desc in the tree with head
-h, returns NULL if the Path isn't in the tree */
-tree search_tree(tree h, string *desc)
+/* discards the sets and deletes of the transaction */
+void discard()
 {
-    if(h == NULL)
-        return NULL;
-
-    if(equal(h->path->desc, desc))
-        return h;
-    
-    if(less(desc, h->path->desc))
-        return search_tree(h->left, desc);
-    
-    else
-        return search_tree(h->right, desc);
+    if(transaction == NULL) {
+        fprintf(out, "%s\n", NO_TRANSACTION);
+        return;
+    }
+    store_abort(transaction);
+    transaction = NULL;
 }
 
-/* inserts a new Path in the tree with head h */
-tree insert(tree h, Path *path)
+/* executes the command with name command on the store s,
+reading its arguments from input */
+void run_command(char command[], store *s)
 {
-    if(h == NULL)
-        return new_h(path, NULL, NULL);
-
-    if(less(path->desc, h->path->desc))
-        h->left = insert(h->left, path);
-    
-    else
-        h->right = insert(h->right, path);
-    h = AVLbalance(h);
-    return h;
+#ifdef PROFILE
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if(strcmp(command, "profile") == 0)
+        print_profile(out);
+#endif
+    if(strcmp(command, "help") == 0)
+        help();        
+    if(strcmp(command, "set") == 0) {
+        getc(in); /* space */
+        set(s); }
+    if(strcmp(command, "print") == 0)  print(s);
+    if(strcmp(command, "printpage") == 0)  print_page(s);
+    if(strcmp(command, "listpage") == 0)  list_page(s);
+    if(strcmp(command, "scan") == 0) {
+        getc(in); /* space */
+        scan(s); }
+    if(strcmp(command, "find") == 0) {
+        getc(in); /* space */
+        find(s); }
+    if(strcmp(command, "list") == 0)  list(s);
+    if(strcmp(command, "stats") == 0)  stats(s);
+    if(strcmp(command, "search") == 0) {
+        getc(in); /* space */
+        search(s); }
+    if(strcmp(command, "startswith") == 0) {
+        getc(in); /* space */
+        search_values(s, FALSE); }
+    if(strcmp(command, "contains") == 0) {
+        getc(in); /* space */
+        search_values(s, TRUE); }
+    if(strcmp(command, "delete") == 0)  delete(s);
+    if(strcmp(command, "move") == 0) {
+        getc(in); /* space */
+        move(s, FALSE); }
+    if(strcmp(command, "clone") == 0) {
+        getc(in); /* space */
+        move(s, TRUE); }
+    if(strcmp(command, "begin") == 0)  begin();
+    if(strcmp(command, "commit") == 0)  commit(s);
+    if(strcmp(command, "abort") == 0)  discard();
+    if(strcmp(command, "budget") == 0)  budget(s);
+    if(strcmp(command, "watch") == 0)  watch(s);
+    if(strcmp(command, "unwatch") == 0)  unwatch(s);
+#ifdef PROFILE
+    profile_command(command, &start);
+#endif
 }
 
-/* returns the subtree with max value from the tree with head h */
-tree max(tree h)
+#ifdef SERVER
+/* with -DSERVER and a socket path as argument the store is served to many
+clients through a Unix domain socket, every client sends the same commands as
+the input and gets the same output, a single thread multiplexes all of them
+with epoll, never blocking on a client, and runs each of their commands whole
+against the one store they share, except for the prints of whole iterations,
+which are run in batches on a snapshot */
+
+/* a connected client, its input that wasn't run yet, as some of its commands
+may still be incomplete, its output that wasn't written yet and the print
+and the transaction it's running, if any, a client that was given changes
+of the paths it watches while another one ran a command is notified, and
+the changes it wasn't given while too much of its output was waiting are
+counted as lost */
+typedef struct client {
+    int fd, quit, hangup, notified;
+    long lost;
+    batch print;
+    store_txn *transaction;
+    char *input;
+    int input_used, input_size;
+    char *output;
+    long output_start, output_used, output_size;
+    struct client *next, *previous, *next_notified;
+} client;
+
+client *clients = NULL, *notified = NULL;
+volatile sig_atomic_t stop_server = FALSE;
+
+/* marks the server to stop, called on SIGINT and SIGTERM */
+void handle_stop(int sig)
 {
-    while(h != NULL && h->right != NULL)
-        h = h->right;
-
-    return h;
+    if(sig == SIGINT || sig == SIGTERM)
+        stop_server = TRUE;
 }
 
-/* returns the subtree with minimum value from the tree with head h */
-tree min(tree h)
+/* makes the reads and writes of the file descriptor fd return
+instead of blocking */
+void set_nonblocking(int fd)
 {
-    while(h != NULL && h->left != NULL)
-        h = h->left;
-
-    return h;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 }
 
-/* removes and deletes the Path with description desc from the
-tree with head h */
-tree delete_tree(tree h, string *desc)
+/* returns a new socket listening at path, or -1 if it can't be created */
+int listen_socket(char *path)
 {
-    tree aux;
-
-    if(h == NULL) return h;
-    if(less(desc, h->path->desc))  h->left = delete_tree(h->left, desc);
-    else if(less(h->path->desc, desc))  h->right = delete_tree(h->right, desc);   
-    else {
-        if(h->left != NULL && h->right != NULL) {
-            Path *x = h->path;
-            aux = max(h->left);
-            h->path = aux->path;
-            aux->path = x;
-            h->left = delete_tree(h->left, aux->path->desc); }
-        else {
-            aux = h;
-            if(h->left == NULL && h->right == NULL) h = NULL;
-            else if(h->left == NULL) h = h->right;
-            else h = h->left;            
-            free(aux); }
+    struct sockaddr_un address;
+    int fd;
+
+    if(strlen(path) >= sizeof(address.sun_path))
+        return -1;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    unlink(path); /* a socket left by a server that didn't stop cleanly */
+    if(bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0 ||
+       listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
     }
-    h = AVLbalance(h);
-    return h;
+    set_nonblocking(fd);
+    return fd;
 }
 
-/* frees all memory associated with the tree with head h */
-void free_tree(tree h)
-{   
-    if(h == NULL)
-        return;
-
-    free_path(h->path);
-    free_tree(h->left);
-    free_tree(h->right);
-    free(h);
+/* adds a new client connected through the file descriptor fd
+to the clients and to the events of epoll */
+void add_client(int epoll, int fd)
+{
+    client *c = malloc(sizeof(client));
+    struct epoll_event event;
+
+    set_nonblocking(fd);
+    c->fd = fd;
+    c->quit = FALSE;
+    c->hangup = FALSE;
+    c->notified = FALSE;
+    c->lost = 0;
+    c->print.it = NULL;
+    c->transaction = NULL;
+    c->input_size = READ_SIZE;
+    c->input_used = 0;
+    c->input = malloc(c->input_size);
+    c->output_size = READ_SIZE;
+    c->output_start = c->output_used = 0;
+    c->output = malloc(c->output_size);
+
+    c->previous = NULL;
+    c->next = clients;
+    if(clients != NULL)
+        clients->previous = c;
+    clients = c;
+
+    event.events = EPOLLIN;
+    event.data.ptr = c;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
 }
 
-/* a doubly linked list that store pointers to all existing paths in order of creation */
-typedef struct pathnode {
-    struct pathnode *next;
-    struct pathnode *previous;
-    Path *path;
-} path_node;
-
-typedef struct {
-    struct pathnode *first, *last;
-} path_list;
-
-path_list *mk_pathlist();
-void free_pathlist(path_list *list);
-void add_to_pathlist(path_list *list, path_node *next, Path *path);
-path_node* where_to_add_pathlist(path_list *list, Path *path);
-path_node* find_item_pathlist(path_list *list, string *desc);
-path_node* remove_item_path_list(path_list *list, path_node *node);
-
-/* creates and returns a new empty path_list */
-path_list *mk_pathlist()
+/* disconnects the client c, which stops watching the paths of the store s,
+and frees all memory associated with it */
+void remove_client(int epoll, client *c, store *s)
 {
-    path_list *new_list = malloc(sizeof(path_list));
-
-    new_list->first = NULL;
-    new_list->last = NULL;
+    epoll_ctl(epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
 
-    return new_list;
+    if(c->previous != NULL)
+        c->previous->next = c->next;
+    else
+        clients = c->next;
+    if(c->next != NULL)
+        c->next->previous = c->previous;
+
+    if(c->print.it != NULL)
+        store_iter_free(c->print.it);
+    if(c->transaction != NULL)
+        store_abort(c->transaction);
+    store_unwatch_all(s, c);
+    free(c->input);
+    free(c->output);
+    free(c);
 }
 
-/* frees the path_list list but doesn't free the memory associated
-with its paths */
-void free_pathlist(path_list *list)
+/* adds length chars to the output waiting to be written to the client c */
+void add_output(client *c, char *chars, long length)
 {
-    while(list->first != NULL) {
-        path_node *next = list->first->next;
-        free(list->first);
-        list->first = next;
-    }
-    free(list);
-}
-
-/* adds the Path path to the path_list list before the path_node next*/
-void add_to_pathlist(path_list *list, path_node *next, Path *path)
-{
-    path_node *new_node = malloc(sizeof(struct pathnode));
-
-    new_node->path = path;
-    new_node->next = next;
-    if(next == NULL && list->first == NULL) {
-        list->first = new_node;
-        list->last = new_node;
-        new_node->previous = NULL;
-        return; }
-    if(next == NULL) {
-        new_node->previous = list->last;
-        list->last->next = new_node;
-        list->last = new_node;
-        return; }
-    if(next == list->first) {
-        list->first = new_node;
-        next->previous = new_node;
-        new_node->previous = NULL;
-        return; }
-    new_node->previous = next->previous;
-    next->previous->next = new_node;
-    next->previous = new_node;
-}
-
-/* returns the path_node next to where the new path should be added */
-path_node* where_to_add_pathlist(path_list *list, Path *path)
-{
-    path_node *current;
-    string *mother;
-    int num;
-    
-    if(list->first == NULL) 
-        return NULL;
-    if(number_subpaths(path->desc) == 1) 
-        return NULL;
-    current = list->first;
-    mother = mother_path(path->desc);
-    num = number_subpaths(mother);
-    for(; current != NULL; current = current->next) {
-        if(equal(current->path->desc, mother))
-            break; }
-    if(current == NULL) {
-        free_string(mother);
-        return NULL; }
-    for(current = current->next; current != NULL; current = current->next) {
-        if(number_subpaths(current->path->desc) <= num) 
-            break; }
-    free_string(mother);
-    return current;
-}
-
-/* finds the path with description desc in the list, returns 
-its node if the path is found and NULL if it doesn't exist */
-path_node* find_item_pathlist(path_list *list, string *desc)
-{
-    path_node *current = list->first;
-
-    for(; current != NULL; current = current->next) {
-        if(equal(desc, current->path->desc)) {
-            return current;
-        }
+    if(length == 0)
+        return;
+    if(c->output_start > 0 && c->output_start == c->output_used)
+        c->output_start = c->output_used = 0;
+    if(c->output_used + length > c->output_size) {
+        /* drops what was already written before making room for more */
+        memmove(c->output, c->output + c->output_start,
+                c->output_used - c->output_start);
+        c->output_used -= c->output_start;
+        c->output_start = 0;
+        while(c->output_used + length > c->output_size)
+            c->output_size *= 2;
+        c->output = realloc(c->output, c->output_size);
     }
-    return NULL;
+    memcpy(c->output + c->output_used, chars, length);
+    c->output_used += length;
 }
 
-/* frees the path_node node and returns the next node */
-path_node* remove_item_path_list(path_list *list, path_node *node)
+/* tells the client c how many changes it lost, once there's room for
+its output again */
+void add_lost(client *c)
 {
-    path_node *next = node->next;
-
-    if(node != list->first) 
-        node->previous->next = node->next;
-    else 
-        list->first = node->next;
-
-    if(node != list->last) 
-        node->next->previous = node->previous;
-    else
-        list->last = node->previous;
-            
-    free_path(node->path);
-    free(node);
-
-    return next;
-}
+    char line[MAX_LOST];
 
-/* prints all available comands and their descriptions */
-void help()
-{
-    printf("%s\n%s\n%s\n%s\n%s\n%s\n%s\n%s\n", HELP_DESC, QUIT_DESC, SET_DESC,
-    PRINT_DESC, FIND_DESC, LIST_DESC, SEARCH_DESC, DELETE_DESC);
-}
-
-/* adds a new path and all its mother paths that don't already exist
-to the tree head and to the path_list plist */
-tree add_new_path(tree alph, path_list *list, string *desc, string *value)
-{
-    string *dir = desc;
-    path_node *next = NULL;
-    Path *new_path;
-    int i, num_dir = number_subpaths(desc), found = 0;
-
-    for(i = 1; i < num_dir; i++) {
-        dir = n_dir(desc, i);
-        if(alph == NULL) {
-            new_path = mk_path(dir, NULL);
-            alph = new_h(new_path, NULL, NULL);
-            add_to_pathlist(list, NULL, new_path);
-            found = 1; }
-        else if(search_tree(alph, dir) == NULL) {
-            new_path = mk_path(dir, NULL);
-            if(found == 0) {
-                next = where_to_add_pathlist(list, new_path);
-                found = 1; }
-            add_to_pathlist(list, next, new_path);
-            alph = insert(alph, new_path); }
-        else free_string(dir); }
-    if(alph == NULL) {
-        new_path = mk_path(desc, value);
-        alph = new_h(new_path, NULL, NULL);
-        add_to_pathlist(list, NULL, new_path);
-        return alph; }
-    new_path = mk_path(desc, value);
-    if(found == 0) next = where_to_add_pathlist(list, new_path);
-    add_to_pathlist(list, next, new_path);
-    alph = insert(alph, new_path);
-    return alph;
+    if(c->lost == 0 || c->output_used - c->output_start >= MAX_PENDING)
+        return;
+    sprintf(line, "%s %ld\n", LOST, c->lost);
+    add_output(c, line, strlen(line));
+    c->lost = 0;
 }
 
-/* adds or modifies a value */
-tree set(tree alph, path_list *list)
+/* gives the change of the value of a path to the client watcher that watches
+it, in the output of the command it runs if it's the one running it, or else
+after its output that wasn't written yet, marking it as notified, unless too
+much of that output is waiting, in which case the change is lost so that a
+client that doesn't read can't make the output of the server grow forever */
+void notify(void *watcher, const char *path, size_t path_length,
+            const char *old_value, size_t old_length,
+            const char *new_value, size_t new_length)
 {
-    string *desc = read_path_desc();
-    string *new_value = read_path_value();
-    string *old_value;
-    tree head;
-
-    if(alph == NULL) {
-        alph = add_new_path(alph, list, desc, new_value);
-        return alph;
+    client *c = watcher;
+    FILE *command_out = out;
+    char *output = NULL;
+    size_t size = 0;
+
+    if(c == subscriber) {
+        print_change(path, path_length, old_value, old_length, new_value,
+                     new_length);
+        return;
+    }
+    if(c->output_used - c->output_start >= MAX_PENDING) {
+        c->lost++;
+        return;
     }
-    if((head = search_tree(alph, desc)) != NULL) {
-        old_value = head->path->value;
-        head->path->value = new_value;
-        free_string(old_value);
-        free_string(desc);
-        return alph;
+    add_lost(c);
+    out = open_memstream(&output, &size);
+    print_change(path, path_length, old_value, old_length, new_value,
+                 new_length);
+    fclose(out);
+    out = command_out;
+    add_output(c, output, size);
+    free(output);
+    if(!c->notified) {
+        c->notified = TRUE;
+        c->next_notified = notified;
+        notified = c;
     }
-    alph = add_new_path(alph, list, desc, new_value);
-    return alph;
 }
 
-/* prints all paths and values */
-void print(path_list *list)
+/* runs the command in the line of the client c, which ends in a '\n', on the
+store s, keeping its output to be written to the client */
+void run_line(client *c, char *line, int length, store *s)
 {
-    path_node *current = list->first;
-
-    for(; current != NULL; current = current->next) {
-        if(current->path->value != NULL) {
-            print_str(current->path->desc);
-            printf(" ");
-            print_str(current->path->value);
-            printf("\n");
-        }
+    static char command[MAX_CHAR_INST];
+    char *output = NULL;
+    size_t size = 0;
+
+    in = fmemopen(line, length, "r");
+    out = open_memstream(&output, &size);
+    batched = &c->print;
+    transaction = c->transaction;
+    subscriber = c;
+    if(fscanf(in, "%s", command) == 1) {
+        if(strcmp(command, "quit") == 0)
+            c->quit = TRUE;
+        else
+            run_command(command, s);
     }
+    batched = NULL;
+    c->transaction = transaction;
+    transaction = NULL;
+    subscriber = NULL;
+    fclose(in);
+    fclose(out);
+    in = stdin;
+    out = stdout;
+
+    add_output(c, output, size);
+    free(output);
 }
 
-/* prints the value stored in a path */
-void find(tree alph)
+/* prints the next batch of the print the client c is running,
+keeping its output to be written to the client */
+void run_print(client *c)
 {
-    string *desc = read_path_desc();
-    tree h;
-
-    h = search_tree(alph, desc);
-
-    free_string(desc);
+    char *output = NULL;
+    size_t size = 0;
 
-    if(h == NULL) {
-        printf("%s\n", NOT_FOUND);
-        return;
-    }
-    if(h->path->value == NULL) {
-        printf("%s\n", NO_DATA);
-        return;
+    out = open_memstream(&output, &size);
+    if(!print_from(c->print.it, PRINT_BATCH, c->print.names, FALSE)) {
+        store_iter_free(c->print.it);
+        c->print.it = NULL;
     }
+    fclose(out);
+    out = stdout;
 
-    print_str(h->path->value);
-    printf("\n");
+    add_output(c, output, size);
+    free(output);
 }
 
-/* lists all directory dir components */
-void list(tree alph, string *dir)
-{   
-    string *aux, *subdir;
-
-    if(alph == NULL)
-        return;
-    
-    list(alph->right, dir);
+/* runs every complete command line the client c sent on the store s,
+until it quits, starts a print or too much of its output is waiting */
+void run_input(client *c, store *s)
+{
+    char *end;
+    int start = 0;
+
+    while(!c->quit && c->print.it == NULL &&
+          c->output_used - c->output_start < MAX_PENDING &&
+          (end = memchr(c->input + start, '\n', c->input_used - start)) != NULL) {
+        run_line(c, c->input + start, end + 1 - (c->input + start), s);
+        start = end + 1 - c->input;
+    }
+    memmove(c->input, c->input + start, c->input_used - start);
+    c->input_used -= start;
+}
 
-    if(len(alph->path->desc) > len(dir)) {
-        if((subdir = sub_dir(alph->path->desc, dir)) != NULL) {
-            aux = remove_directory(dir, alph->path->desc);
-            remove_first_string(aux);   
+/* reads everything the client c has sent, returns FALSE if
+it closed the connection and TRUE otherwise */
+int read_input(client *c)
+{
+    long count;
 
-            if(equal(subdir, aux)) {
-                print_str(subdir);
-                printf("\n");
-            }
-            free_string(aux);
-            free_string(subdir);
+    for(;;) {
+        if(c->input_size - c->input_used < READ_SIZE) {
+            c->input_size *= 2;
+            c->input = realloc(c->input, c->input_size);
         }
+        count = recv(c->fd, c->input + c->input_used,
+                     c->input_size - c->input_used, 0);
+        if(count > 0)
+            c->input_used += count;
+        else if(count < 0 && errno == EINTR)
+            continue;
+        else
+            return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
     }
+}
 
-    list(alph->left, dir);
+/* writes as much of the output waiting for the client c as it takes,
+returns FALSE if the connection failed and TRUE otherwise */
+int write_output(client *c)
+{
+    long count;
+
+    while(c->output_start < c->output_used) {
+        count = send(c->fd, c->output + c->output_start,
+                     c->output_used - c->output_start, MSG_NOSIGNAL);
+        if(count > 0)
+            c->output_start += count;
+        else if(count < 0 && errno == EINTR)
+            continue;
+        else
+            return count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+    return TRUE;
 }
 
-/* searchs for a path through its value */
-void search(path_list *list)
+/* makes epoll wait for the input of the client c unless it's done sending
+or too much of its output is waiting, and for room to write the output,
+or to print the next batch of its print */
+void update_events(int epoll, client *c)
 {
-    string *value = read_path_value();
-    path_node *current = list->first;
+    struct epoll_event event;
+    long pending = c->output_used - c->output_start;
+
+    event.events = 0;
+    if(!c->quit && !c->hangup && pending < MAX_PENDING)
+        event.events |= EPOLLIN;
+    if(pending > 0 || c->print.it != NULL)
+        event.events |= EPOLLOUT;
+    event.data.ptr = c;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, c->fd, &event);
+}
 
-    for(; current != NULL; current = current->next) {
-        if(equal(current->path->value, value)) {
-            free_string(value);
-            print_str(current->path->desc);
-            printf("\n");
+/* makes epoll wait for room to write the output of the clients that were
+given changes of the paths they watch */
+void update_notified(int epoll)
+{
+    client *c;
 
-            return;
-        }
+    while((c = notified) != NULL) {
+        notified = c->next_notified;
+        c->notified = FALSE;
+        update_events(epoll, c);
     }
-
-    printf("%s\n", NOT_FOUND);
-    free_string(value);
 }
 
-/* deletes a path and all its subpaths */
-tree delete(tree alph, path_list *plist)
+/* handles the events of the client c, running its commands on the store s,
+and removes it once it's done and all its output was written */
+void serve_client(int epoll, client *c, unsigned events, store *s)
 {
-    string *dir, *desc = read_path_desc();
-    path_node *node;
-    int n = number_subpaths(desc);
+    int ok, done;
+
+    if((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !read_input(c))
+        c->hangup = TRUE;
+    /* the commands already read are run even if the client closed its side,
+    since it may still be waiting for their output, and while their output
+    is written whole more of them can run, but a print only runs one batch
+    at a time so that the other clients are served in between */
+    do {
+        if(c->print.it != NULL &&
+           c->output_used - c->output_start < MAX_PENDING)
+            run_print(c);
+        run_input(c, s);
+        ok = write_output(c);
+    } while(ok && !c->quit && c->print.it == NULL &&
+            c->output_start == c->output_used &&
+            memchr(c->input, '\n', c->input_used) != NULL);
+    add_lost(c);
+
+    done = c->quit || (c->hangup && c->print.it == NULL &&
+                       memchr(c->input, '\n', c->input_used) == NULL);
+    if(!ok || (done && c->output_start == c->output_used))
+        remove_client(epoll, c, s);
+    else
+        update_events(epoll, c);
+}
 
-    node = find_item_pathlist(plist, desc);
+/* serves the store s to the clients that connect to the socket at path
+until SIGINT or SIGTERM */
+void serve(char *path, store *s)
+{
+    struct epoll_event event, events[MAX_EVENTS];
+    struct sigaction action;
+    int i, count, fd, epoll, listener = listen_socket(path);
 
-    if(node == NULL) {
-        printf("%s\n", NOT_FOUND);
-        free_string(desc);
-        return alph;
+    if(listener < 0) {
+        perror(path);
+        return;
     }
-    while(node != NULL && equal(desc, (dir = n_dir(node->path->desc, n)))) {
-        free_string(dir);
-        alph = delete_tree(alph, node->path->desc);
-        node = remove_item_path_list(plist, node);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    epoll = epoll_create(MAX_EVENTS);
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+    while(!stop_server) {
+        if((count = epoll_wait(epoll, events, MAX_EVENTS, -1)) < 0)
+            continue; /* interrupted by a signal */
+        for(i = 0; i < count; i++) {
+            if(events[i].data.ptr != NULL) {
+                serve_client(epoll, events[i].data.ptr, events[i].events, s);
+                update_notified(epoll);
+            }
+            else
+                while((fd = accept(listener, NULL, NULL)) >= 0)
+                    add_client(epoll, fd);
+        }
     }
-    if(node != NULL) 
-        free_string(dir);
-    free_string(desc);
-    return alph;
+    while(clients != NULL)
+        remove_client(epoll, clients, s);
+    close(epoll);
+    close(listener);
+    unlink(path);
 }
+#endif
 
+#ifdef SERVER
+int main(int argc, char *argv[])
+#else
 int main()
+#endif
 {
     char command[MAX_CHAR_INST];
-    tree alph = NULL;
-    path_list *plist = mk_pathlist();
-
-    scanf("%s", command);
-    for(;strcmp(command, "quit") != 0; scanf("%s", command)) {
-        if(strcmp(command, "help") == 0)
-            help();        
-        if(strcmp(command, "set") == 0) {
-            getchar(); /* space */
-            alph = set(alph, plist); }
-        if(strcmp(command, "print") == 0)  print(plist);
-        if(strcmp(command, "find") == 0) {
-            getchar(); /* space */
-            find(alph); }
-        if(strcmp(command, "list") == 0) {
-            string *dir;
-            if(getchar() == '\n') {
-                dir = NULL;
-                if(plist->first != NULL) list(alph, dir);
-                else printf("%s\n", NOT_FOUND); }
-            else {
-                dir = read_path_desc();
-                if(search_tree(alph, dir) != NULL) list(alph, dir);
-                else printf("%s\n", NOT_FOUND); }
-            if(dir != NULL) free_string(dir);
-            else free(dir); }
-        if(strcmp(command, "search") == 0) {
-            getchar(); /* space */
-            search(plist); }
-        if(strcmp(command, "delete") == 0) {
-            if(getchar() == '\n') {
-                if(alph != NULL) {
-                    free_pathlist(plist);
-                    free_tree(alph);
-                    plist = mk_pathlist();
-                    alph = NULL; } }
-            else alph = delete(alph, plist); }  
-    }
-    free_pathlist(plist);
-    free_tree(alph);
+    store *s = store_open();
+
+    in = stdin;
+    out = stdout;
+#ifdef SERVER
+    if(argc > 1)
+        serve(argv[1], s);
+    else
+#endif
+    for(fscanf(in, "%s", command); strcmp(command, "quit") != 0;
+        fscanf(in, "%s", command))
+        run_command(command, s);
+#ifdef PROFILE
+    print_profile(stderr);
+#endif
+    if(transaction != NULL)
+        store_abort(transaction);
+
+    store_close(s);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,3834 @@
+/*
+ * File: store.c
+ * Author: Sofia Pinho
+ * Description: The hierarchical storage system of proj2, kept apart from its
+ * commands so that it can also be used as a library through store.h.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "store.h"
+
+/* value table sizes and hash constants */
+#define INIT_BUCKETS  1024
+#define INIT_HEAP     4096
+#define INIT_WATCHERS 64
+#define INIT_IDS      64
+#define MIN_UNSORTED  64 /* values left unsorted before they're merged */
+#define FNV_OFFSET    2166136261UL
+#define FNV_PRIME     16777619UL
+#define AFTER_SLASH   ('/' + 1) /* first char that sorts after a '/' */
+#define NOT_SPILLED   -1L /* spill of a path whose subpaths are in memory */
+#define SPILLED_GRAMS (1L << 16) /* bits of the grams of spilled values */
+/* boolean values */
+#define TRUE          1
+#define FALSE         0
+
+#ifdef PROFILE
+#define PROFILE_EVENT(event) (profile_events[event]++)
+
+const char *event_names[NUM_EVENTS] = {"stringcmp", "alloc", "rotation"};
+unsigned long profile_events[NUM_EVENTS];
+#else
+#define PROFILE_EVENT(event)
+#endif
+
+/* structs and prototypes */
+/* a value stored once and shared by every path that holds the same content,
+its chars live in the value heap and it is freed when no path references it */
+typedef struct valuenode {
+    struct valuenode *next; /* next value in the same hash bucket */
+    unsigned long hash;
+    int offset, length; /* position of the chars in the value heap */
+    int refs;
+    int id; /* position in the index of the values, once there's one */
+    struct path *holders; /* paths it's the current value of */
+} Value;
+
+/* a trigram, three chars packed in a number, with the ids of the values that
+contain it in the order they were indexed, some of which may be of values that
+were released since, and the next trigram in its bucket */
+typedef struct posting {
+    unsigned long gram;
+    int *ids;
+    int used, size;
+    struct posting *next;
+} posting;
+
+/* an index of the values of a value_table, built the first time they're
+searched by a part of them: by_id maps the id of every value indexed to it, or
+to NULL once it's released, sorted keeps the values with ids below
+first_unsorted in the order of their chars, with NULL in place of the released
+ones, and grams maps every trigram of the values to its postings */
+typedef struct {
+    Value **by_id;
+    int num_ids, ids_size, dead_ids;
+    Value **sorted;
+    int sorted_used, sorted_dead, first_unsorted;
+    posting **grams;
+    int num_grams, grams_buckets;
+    long postings;
+} value_index;
+
+/* a hash table of all distinct values and the contiguous heap that holds
+their chars, and their index, NULL until they're first searched by a part */
+typedef struct {
+    Value **buckets;
+    int num_buckets, num_values;
+    char *heap;
+    int heap_used, heap_size, heap_wasted;
+    value_index *index;
+} value_table;
+
+value_table* mk_value_table();
+void free_value_table(value_table *values);
+void free_index(value_index *index);
+void index_value(value_index *index, Value *v, const char *heap);
+void unindex_value(value_index *index, Value *v, const char *heap);
+unsigned long hash_char(unsigned long hash, char c);
+Value* lookup_value(value_table *values, const char *chars, int length,
+                    unsigned long hash);
+Value* intern_value(value_table *values, const char *chars, int length,
+                    unsigned long hash);
+void release_value(value_table *values, Value *v);
+
+/* returns a new empty value_table */
+value_table* mk_value_table()
+{
+    value_table *values = malloc(sizeof(value_table));
+
+    values->num_buckets = INIT_BUCKETS;
+    values->num_values = 0;
+    values->buckets = calloc(values->num_buckets, sizeof(Value*));
+    values->heap_size = INIT_HEAP;
+    values->heap_used = 0;
+    values->heap_wasted = 0;
+    values->heap = malloc(values->heap_size);
+    values->index = NULL;
+
+    return values;
+}
+
+/* frees the value_table values and every value in it */
+void free_value_table(value_table *values)
+{
+    int i;
+
+    for(i = 0; i < values->num_buckets; i++) {
+        while(values->buckets[i] != NULL) {
+            Value *next = values->buckets[i]->next;
+            free(values->buckets[i]);
+            values->buckets[i] = next;
+        }
+    }
+    free(values->buckets);
+    free(values->heap);
+    free_index(values->index);
+    free(values);
+}
+
+/* returns hash updated with the char c, so that a value can be hashed
+while it is being read */
+unsigned long hash_char(unsigned long hash, char c)
+{
+    return ((hash ^ (unsigned char) c) * FNV_PRIME) & 0xffffffffUL;
+}
+
+/* returns the value with the given chars if it's in the table,
+NULL otherwise */
+Value* lookup_value(value_table *values, const char *chars, int length,
+                    unsigned long hash)
+{
+    Value *v = values->buckets[hash % values->num_buckets];
+
+    for(; v != NULL; v = v->next) {
+        if(v->hash == hash && v->length == length &&
+           memcmp(values->heap + v->offset, chars, length) == 0)
+            return v;
+    }
+    return NULL;
+}
+
+/* doubles the number of buckets of the table values */
+void grow_buckets(value_table *values)
+{
+    int i, num = values->num_buckets * 2;
+    Value **buckets = calloc(num, sizeof(Value*));
+
+    for(i = 0; i < values->num_buckets; i++) {
+        while(values->buckets[i] != NULL) {
+            Value *v = values->buckets[i];
+            values->buckets[i] = v->next;
+            v->next = buckets[v->hash % num];
+            buckets[v->hash % num] = v;
+        }
+    }
+    free(values->buckets);
+    values->buckets = buckets;
+    values->num_buckets = num;
+}
+
+/* copies the chars of every live value to a new heap, leaving out
+the space of the values that were freed */
+void compact_heap(value_table *values)
+{
+    int i, used = 0;
+    char *heap = malloc(values->heap_size);
+    Value *v;
+
+    for(i = 0; i < values->num_buckets; i++) {
+        for(v = values->buckets[i]; v != NULL; v = v->next) {
+            memcpy(heap + used, values->heap + v->offset, v->length);
+            v->offset = used;
+            used += v->length;
+        }
+    }
+    free(values->heap);
+    values->heap = heap;
+    values->heap_used = used;
+    values->heap_wasted = 0;
+}
+
+/* returns a new reference to the value with the given chars,
+adding it to the table if it's not there yet */
+Value* intern_value(value_table *values, const char *chars, int length,
+                    unsigned long hash)
+{
+    Value *v = lookup_value(values, chars, length, hash);
+
+    if(v != NULL) {
+        v->refs++;
+        return v;
+    }
+    if(values->heap_used + length > values->heap_size) {
+        if(values->heap_wasted > values->heap_used / 2)
+            compact_heap(values);
+        while(values->heap_used + length > values->heap_size)
+            values->heap_size *= 2;
+        values->heap = realloc(values->heap, values->heap_size);
+    }
+    if(values->num_values >= values->num_buckets)
+        grow_buckets(values);
+
+    v = malloc(sizeof(Value));
+    PROFILE_EVENT(EV_ALLOC);
+    v->hash = hash;
+    v->length = length;
+    v->offset = values->heap_used;
+    v->refs = 1;
+    v->holders = NULL;
+    memcpy(values->heap + v->offset, chars, length);
+    values->heap_used += length;
+
+    v->next = values->buckets[hash % values->num_buckets];
+    values->buckets[hash % values->num_buckets] = v;
+    values->num_values++;
+    if(values->index != NULL)
+        index_value(values->index, v, values->heap);
+
+    return v;
+}
+
+/* drops a reference to the value v, removing it from the table
+when no path uses it anymore */
+void release_value(value_table *values, Value *v)
+{
+    Value **link;
+
+    if(v == NULL || --v->refs > 0)
+        return;
+
+    link = &values->buckets[v->hash % values->num_buckets];
+    while(*link != v)
+        link = &(*link)->next;
+    *link = v->next;
+
+    if(values->index != NULL)
+        unindex_value(values->index, v, values->heap);
+    values->num_values--;
+    values->heap_wasted += v->length;
+    free(v);
+}
+
+/* returns the trigram of the three chars of chars that start at i */
+unsigned long gram_at(const char *chars, int i)
+{
+    return ((unsigned long) (unsigned char) chars[i] << 16) |
+           ((unsigned long) (unsigned char) chars[i + 1] << 8) |
+           (unsigned char) chars[i + 2];
+}
+
+/* returns the postings of the trigram gram in index, NULL if there are none */
+posting* find_posting(value_index *index, unsigned long gram)
+{
+    posting *p = index->grams[gram % index->grams_buckets];
+
+    while(p != NULL && p->gram != gram)
+        p = p->next;
+    return p;
+}
+
+/* adds the id of a value that contains the trigram gram to its postings
+in index, unless it was just added for an earlier trigram of the value */
+void add_posting(value_index *index, unsigned long gram, int id)
+{
+    posting *p = find_posting(index, gram), **grams, *next;
+    int i, num = index->grams_buckets * 2;
+
+    if(p == NULL) {
+        if(index->num_grams >= index->grams_buckets) {
+            grams = calloc(num, sizeof(posting*));
+            for(i = 0; i < index->grams_buckets; i++)
+                for(p = index->grams[i]; p != NULL; p = next) {
+                    next = p->next;
+                    p->next = grams[p->gram % num];
+                    grams[p->gram % num] = p;
+                }
+            free(index->grams);
+            index->grams = grams;
+            index->grams_buckets = num;
+        }
+        p = malloc(sizeof(posting));
+        p->gram = gram;
+        p->used = 0;
+        p->size = 4;
+        p->ids = malloc(p->size * sizeof(int));
+        p->next = index->grams[gram % index->grams_buckets];
+        index->grams[gram % index->grams_buckets] = p;
+        index->num_grams++;
+    }
+    else if(p->used > 0 && p->ids[p->used - 1] == id)
+        return;
+    if(p->used == p->size) {
+        p->size *= 2;
+        p->ids = realloc(p->ids, p->size * sizeof(int));
+    }
+    p->ids[p->used++] = id;
+    index->postings++;
+}
+
+/* adds the Value v, whose chars are in heap, to index, as the last
+value that isn't sorted yet */
+void index_value(value_index *index, Value *v, const char *heap)
+{
+    int i;
+
+    if(index->num_ids == index->ids_size) {
+        index->ids_size *= 2;
+        index->by_id = realloc(index->by_id, index->ids_size * sizeof(Value*));
+    }
+    v->id = index->num_ids++;
+    index->by_id[v->id] = v;
+    for(i = 0; i + 2 < v->length; i++)
+        add_posting(index, gram_at(heap + v->offset, i), v->id);
+}
+
+/* returns the result of comparing the length1 chars of chars1 with the
+length2 chars of chars2, as memcmp does, a shorter one first if it starts
+the other one */
+int compare_chars(const char *chars1, int length1,
+                  const char *chars2, int length2)
+{
+    int cmp = memcmp(chars1, chars2, length1 < length2 ? length1 : length2);
+
+    return cmp != 0 ? cmp : length1 - length2;
+}
+
+/* returns the position of the first of the sorted values of index, whose
+chars are in heap, that doesn't come before the length chars of chars,
+skipping the released ones */
+int first_sorted(value_index *index, const char *heap, const char *chars,
+                 int length)
+{
+    int low = 0, high = index->sorted_used, middle, live;
+    Value *v;
+
+    while(low < high) {
+        middle = (low + high) / 2;
+        for(live = middle; live < high && index->sorted[live] == NULL; live++);
+        if(live == high) {
+            high = middle;
+            continue;
+        }
+        v = index->sorted[live];
+        if(compare_chars(heap + v->offset, v->length, chars, length) < 0)
+            low = live + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/* gives every value of index that wasn't released a new id, in the same order
+as their old ones, and drops the released ones from the postings and from the
+sorted values */
+void renumber(value_index *index)
+{
+    int *ids = malloc(index->num_ids * sizeof(int));
+    int i, j, kept, used = 0, first_unsorted = 0;
+    posting **link, *p;
+
+    for(i = 0; i < index->num_ids; i++) {
+        ids[i] = -1;
+        if(index->by_id[i] == NULL)
+            continue;
+        ids[i] = used;
+        index->by_id[i]->id = used;
+        index->by_id[used++] = index->by_id[i];
+        if(i < index->first_unsorted)
+            first_unsorted = used;
+    }
+    index->postings = 0;
+    for(i = 0; i < index->grams_buckets; i++)
+        for(link = &index->grams[i]; (p = *link) != NULL; ) {
+            for(j = kept = 0; j < p->used; j++)
+                if(ids[p->ids[j]] >= 0)
+                    p->ids[kept++] = ids[p->ids[j]];
+            if((p->used = kept) == 0) {
+                *link = p->next;
+                free(p->ids);
+                free(p);
+                index->num_grams--;
+                continue;
+            }
+            index->postings += kept;
+            link = &p->next;
+        }
+    for(i = j = 0; i < index->sorted_used; i++)
+        if(index->sorted[i] != NULL)
+            index->sorted[j++] = index->sorted[i];
+    index->sorted_used = j;
+    index->sorted_dead = 0;
+    index->num_ids = used;
+    index->dead_ids = 0;
+    index->first_unsorted = first_unsorted;
+    free(ids);
+}
+
+/* removes the Value v, whose chars are still in heap, from index, leaving
+NULL in its place, until there are as many of those as values */
+void unindex_value(value_index *index, Value *v, const char *heap)
+{
+    int i;
+
+    index->by_id[v->id] = NULL;
+    index->dead_ids++;
+    if(v->id < index->first_unsorted) {
+        for(i = first_sorted(index, heap, heap + v->offset, v->length);
+            index->sorted[i] != v; i++);
+        index->sorted[i] = NULL;
+        index->sorted_dead++;
+    }
+    if(index->dead_ids > index->num_ids / 2 && index->num_ids > INIT_IDS)
+        renumber(index);
+}
+
+/* the heap of the values compare_values sorts */
+const char *compared_heap;
+
+/* compares the values pointed to by value1 and value2, for qsort */
+int compare_values(const void *value1, const void *value2)
+{
+    const Value *v1 = *(Value* const*) value1, *v2 = *(Value* const*) value2;
+
+    return compare_chars(compared_heap + v1->offset, v1->length,
+                         compared_heap + v2->offset, v2->length);
+}
+
+/* merges the values of index indexed after the sorted ones, whose chars
+are in heap, into them, dropping the released ones */
+void sort_values(value_index *index, const char *heap)
+{
+    Value **recent, **merged;
+    int i, j, k, count = 0;
+
+    recent = malloc((index->num_ids - index->first_unsorted + 1) *
+                    sizeof(Value*));
+    for(i = index->first_unsorted; i < index->num_ids; i++)
+        if(index->by_id[i] != NULL)
+            recent[count++] = index->by_id[i];
+    compared_heap = heap;
+    qsort(recent, count, sizeof(Value*), compare_values);
+    merged = malloc((index->sorted_used - index->sorted_dead + count + 1) *
+                    sizeof(Value*));
+    for(i = j = k = 0; i < index->sorted_used || j < count; ) {
+        if(i < index->sorted_used && index->sorted[i] == NULL)
+            i++;
+        else if(j == count || (i < index->sorted_used &&
+                compare_values(&index->sorted[i], &recent[j]) < 0))
+            merged[k++] = index->sorted[i++];
+        else
+            merged[k++] = recent[j++];
+    }
+    free(index->sorted);
+    free(recent);
+    index->sorted = merged;
+    index->sorted_used = k;
+    index->sorted_dead = 0;
+    index->first_unsorted = index->num_ids;
+}
+
+/* returns the index of the values of values, building it
+the first time it's needed */
+value_index* index_of(value_table *values)
+{
+    value_index *index = values->index;
+    Value *v;
+    int i;
+
+    if(index != NULL)
+        return index;
+    index = values->index = malloc(sizeof(value_index));
+    index->ids_size = INIT_IDS;
+    index->by_id = malloc(index->ids_size * sizeof(Value*));
+    index->num_ids = index->dead_ids = 0;
+    index->sorted = NULL;
+    index->sorted_used = index->sorted_dead = index->first_unsorted = 0;
+    index->grams_buckets = INIT_BUCKETS;
+    index->grams = calloc(index->grams_buckets, sizeof(posting*));
+    index->num_grams = 0;
+    index->postings = 0;
+    for(i = 0; i < values->num_buckets; i++)
+        for(v = values->buckets[i]; v != NULL; v = v->next)
+            index_value(index, v, values->heap);
+    return index;
+}
+
+/* frees the index of values index, if there's one */
+void free_index(value_index *index)
+{
+    posting *p;
+    int i;
+
+    if(index == NULL)
+        return;
+    for(i = 0; i < index->grams_buckets; i++)
+        while((p = index->grams[i]) != NULL) {
+            index->grams[i] = p->next;
+            free(p->ids);
+            free(p);
+        }
+    free(index->grams);
+    free(index->by_id);
+    free(index->sorted);
+    free(index);
+}
+
+/* returns the memory the index of values index takes */
+long index_memory(value_index *index)
+{
+    if(index == NULL)
+        return 0;
+    return sizeof(value_index) + index->ids_size * (long) sizeof(Value*) +
+           index->sorted_used * (long) sizeof(Value*) +
+           index->grams_buckets * (long) sizeof(posting*) +
+           index->num_grams * (long) sizeof(posting) +
+           index->postings * (long) sizeof(int);
+}
+
+/* values found by a search */
+typedef struct {
+    Value **all;
+    int used, size;
+} value_list;
+
+/* returns TRUE if the length chars of chars start with the part_length chars
+of part, if prefix is TRUE, or else contain them */
+int has_part(const char *chars, int length, const char *part, int part_length,
+             int prefix)
+{
+    int i;
+
+    for(i = 0; i + part_length <= length; i++) {
+        if(memcmp(chars + i, part, part_length) == 0)
+            return TRUE;
+        if(prefix)
+            break;
+    }
+    return FALSE;
+}
+
+/* adds the Value v, whose chars are in heap, to found if it isn't NULL and
+has the length chars of part as has_part does, returns TRUE if it was added */
+int check_value(Value *v, const char *heap, const char *part, int length,
+                int prefix, value_list *found)
+{
+    if(v == NULL || !has_part(heap + v->offset, v->length, part, length,
+                              prefix))
+        return FALSE;
+    if(found->used == found->size) {
+        found->size = found->size * 2 + 16;
+        found->all = realloc(found->all, found->size * sizeof(Value*));
+    }
+    found->all[found->used++] = v;
+    return TRUE;
+}
+
+/* adds to found the values of values that start with, if prefix is TRUE, or
+else contain the length chars of part, which isn't empty, the ones that start
+with it through the sorted values, into which the unsorted ones are merged once
+there are enough of them, and the ones that contain it through the postings of
+the trigram of part that the fewest values contain, or by checking all of them
+if part is shorter than a trigram */
+void find_values(value_table *values, const char *part, int length,
+                 int prefix, value_list *found)
+{
+    value_index *index = index_of(values);
+    const char *heap = values->heap;
+    posting *p, *fewest = NULL;
+    int i, kept, first = 0;
+
+    if(prefix) {
+        if(index->num_ids - index->first_unsorted >
+           index->sorted_used / 16 + MIN_UNSORTED)
+            sort_values(index, heap);
+        for(i = first_sorted(index, heap, part, length);
+            i < index->sorted_used; i++)
+            if(index->sorted[i] != NULL &&
+               !check_value(index->sorted[i], heap, part, length, TRUE, found))
+                break;
+        first = index->first_unsorted;
+    }
+    if(prefix || length < 3) {
+        for(i = first; i < index->num_ids; i++)
+            check_value(index->by_id[i], heap, part, length, prefix, found);
+        return;
+    }
+    for(i = 0; i + 2 < length; i++) {
+        if((p = find_posting(index, gram_at(part, i))) == NULL)
+            return;
+        if(fewest == NULL || p->used < fewest->used)
+            fewest = p;
+    }
+    /* the ids of the released values are dropped on the way */
+    for(i = kept = 0; i < fewest->used; i++)
+        if(index->by_id[fewest->ids[i]] != NULL) {
+            fewest->ids[kept++] = fewest->ids[i];
+            check_value(index->by_id[fewest->ids[i]], heap, part, length,
+                        FALSE, found);
+        }
+    index->postings -= fewest->used - kept;
+    fewest->used = kept;
+}
+
+/* a value a path held before it was replaced, kept while a snapshot
+of the store can still see it, since the version it was set in */
+typedef struct old_value {
+    Value *value;
+    long since;
+    struct old_value *next;
+} old_value;
+
+
+/* a directory of the store, which keeps the paths that are its direct
+subpaths in a tree in alphabetical order of their names and in a list in the
+order they were created, shared, refs, by the paths that hold it, a clone and
+the path it was cloned from or a moved path and its old place the snapshots
+still see, which are in a list of their own, sharers, so that the paths above
+a path are found from it, a shared directory is copied by the first path that
+changes it */
+typedef struct dir {
+    struct treenode *names;
+    struct path *first, *last;
+    int refs;
+    struct path *sharers;
+} Dir;
+
+/* a struct which stores the name of a path, without the names of the paths it
+is a subpath of, so that moving a path costs the same whatever the number of
+its subpaths, the pointer to its shared value, value, the directory it is in
+and its own directory, NULL until it has subpaths, the paths before and after
+it in the order of creation, the number of subpaths it has, the total size of
+the values and the total length of the names of the path and its subpaths,
+with the versions of the store in which it was created, born, deleted or moved
+away, died (0 while it exists), and given its value, since, the values it held
+before, newest first, and the deleted path with the same name, all of them
+kept for snapshots, the number of its changes that are queued for when no
+snapshot sees them anymore, where its subpaths were written in the spill file
+if they're not in memory, when it was last looked up, the hash of its name
+with the next path in its bucket of the table of names, its place in the order
+of its directory, and the paths before and after it in the lists of the paths
+that hold its value, that hold its directory and that are spilled */
+typedef struct path {
+    char *name;
+    int length;
+    Value *value;
+    Dir *in, *dir;
+    struct path *next, *previous;
+    int subpaths;
+    long bytes, chars;
+    long born, died, since;
+    old_value *history;
+    struct path *older;
+    int queued;
+    long spill, touched;
+    unsigned long hash;
+    struct path *next_hashed;
+    long order;
+    struct path *next_holder, *previous_holder;
+    struct path *next_sharer, *previous_sharer;
+    struct path *next_spilled, *previous_spilled;
+} Path;
+
+Path* mk_path(const char *name, int length, long version);
+int compare_names(const char *name1, int length1,
+                  const char *name2, int length2);
+unsigned long hash_value(const char *chars, size_t length);
+void free_path(Path *path, value_table *values);
+int visible(Path *path, long version);
+Value* value_at(Path *path, long version);
+void trim_history(Path *path, long version, value_table *values);
+
+/* makes a new path without a value, named by the length chars of name,
+created in version */
+Path* mk_path(const char *name, int length, long version)
+{
+    Path *new_path = malloc(sizeof(Path));
+    PROFILE_EVENT(EV_ALLOC);
+
+    new_path->name = malloc(length + 1);
+    memcpy(new_path->name, name, length);
+    new_path->length = length;
+    new_path->value = NULL;
+    new_path->in = NULL;
+    new_path->dir = NULL;
+    new_path->next = NULL;
+    new_path->previous = NULL;
+    new_path->subpaths = 0;
+    new_path->bytes = 0;
+    new_path->chars = length;
+    new_path->born = new_path->since = version;
+    new_path->died = 0;
+    new_path->history = NULL;
+    new_path->older = NULL;
+    new_path->queued = 0;
+    new_path->spill = NOT_SPILLED;
+    new_path->touched = 0;
+    new_path->hash = hash_value(name, length);
+    new_path->next_hashed = NULL;
+    new_path->order = 0;
+    new_path->next_holder = new_path->previous_holder = NULL;
+    new_path->next_sharer = new_path->previous_sharer = NULL;
+    new_path->next_spilled = new_path->previous_spilled = NULL;
+
+    return new_path;
+}
+
+/* compares the names of length1 and length2 chars name1 and name2 as if
+both ended in a '\0', returns 0 if they're equal, a negative value if name2
+comes after alphabetically and a positive value if the opposite is true, so
+that paths compared name by name keep the order of their descriptions */
+int compare_names(const char *name1, int length1,
+                  const char *name2, int length2)
+{
+    int i;
+
+    PROFILE_EVENT(EV_STRINGCMP);
+    for(i = 0; i < length1 && i < length2; i++)
+        if(name1[i] != name2[i])
+            return name1[i] - name2[i];
+    return (i < length1 ? name1[i] : '\0') - (i < length2 ? name2[i] : '\0');
+}
+
+/* returns the hash of the value in the length chars */
+unsigned long hash_value(const char *chars, size_t length)
+{
+    unsigned long hash = FNV_OFFSET;
+    size_t i;
+
+    for(i = 0; i < length; i++)
+        hash = hash_char(hash, chars[i]);
+    return hash;
+}
+
+/* makes value, NULL for none, the current value of the Path path, moving it
+from the list of the paths that hold its old value to the list of value,
+without changing the references to either one */
+void hold_value(Path *path, Value *value)
+{
+    if(path->value != NULL) {
+        if(path->previous_holder != NULL)
+            path->previous_holder->next_holder = path->next_holder;
+        else
+            path->value->holders = path->next_holder;
+        if(path->next_holder != NULL)
+            path->next_holder->previous_holder = path->previous_holder;
+    }
+    path->value = value;
+    path->previous_holder = NULL;
+    path->next_holder = value != NULL ? value->holders : NULL;
+    if(value != NULL) {
+        if(value->holders != NULL)
+            value->holders->previous_holder = path;
+        value->holders = path;
+    }
+}
+
+/* frees all memory associated with the Path path and releases its values */
+void free_path(Path *path, value_table *values)
+{
+    Value *value = path->value;
+
+    trim_history(path, path->since, values);
+    hold_value(path, NULL);
+    release_value(values, value);
+    free(path->name);
+    free(path);
+}
+
+/* returns TRUE if the Path path exists in the store as it was in version */
+int visible(Path *path, long version)
+{
+    return path->born <= version && (path->died == 0 || path->died > version);
+}
+
+/* returns the value the Path path held in version */
+Value* value_at(Path *path, long version)
+{
+    old_value *old;
+
+    if(path->since <= version)
+        return path->value;
+    for(old = path->history; old != NULL && old->since > version;
+        old = old->next);
+    return old != NULL ? old->value : NULL;
+}
+
+/* releases the values the Path path held before the one it held in version */
+void trim_history(Path *path, long version, value_table *values)
+{
+    old_value **last = &path->history, *old;
+
+    if(path->since > version) {
+        while(*last != NULL && (*last)->since > version)
+            last = &(*last)->next;
+        if(*last != NULL)
+            last = &(*last)->next;
+    }
+    while((old = *last) != NULL) {
+        *last = old->next;
+        release_value(values, old->value);
+        free(old);
+    }
+}
+
+/* an AVL tree that stores pointers to the paths of a directory in alphabetical
+order of their names, each node holds the newest path with its name, in front
+of the deleted ones that are kept for snapshots */
+typedef struct treenode {
+    Path *path;
+    struct treenode *left;
+    struct treenode *right;
+    int height;
+} *tree;
+
+tree new_h(Path *path, tree left, tree right);
+tree search_tree(tree h, const char *name, int length);
+Path* path_at(tree h, long version);
+tree lower_bound(tree h, const char *key, int length, int strict);
+tree insert(tree h, Path *path);
+tree max(tree h);
+tree min(tree h);
+tree delete_tree(tree h, const char *name, int length);
+void free_tree(tree h);
+
+/* creates and returns a new tree with the trees left and
+right in their respective position */
+tree new_h(Path *path, tree left, tree right)
+{
+    tree new = malloc(sizeof(struct treenode));
+    PROFILE_EVENT(EV_ALLOC);
+
+    new->path = path;
+    new->left = left;
+    new->right = right;
+    new->height = 1;
+
+    return new;
+}
+
+/* returns the height of the tree h */
+int height(tree h)
+{
+    if(h == NULL)
+        return 0;
+    return h->height;
+}
+
+/* rotation of tree h to the left */
+tree rotL(tree h)
+{
+    int hleft, hright, xleft, xright;
+    tree x = h->right;
+    h->right = x->left;
+    x->left = h;
+    PROFILE_EVENT(EV_ROTATION);
+
+    hleft = height(h->left);
+    hright = height(h->right);
+    h->height = hleft > hright ? hleft + 1: hright + 1;
+
+    xleft = height(x->left);
+    xright = height(x->right);
+    x->height = xleft > xright ? xleft + 1: xright + 1;
+
+    return x;
+}
+
+/* rotation of tree h to the right */
+tree rotR(tree h)
+{
+    int hleft, hright, xleft, xright;
+    tree x = h->left;
+    h->left = x->right;
+    x->right = h;
+    PROFILE_EVENT(EV_ROTATION);
+
+    hleft = height(h->left);
+    hright = height(h->right);
+    h->height = hleft > hright ? hleft + 1: hright + 1;
+
+    xleft = height(x->left);
+    xright = height(x->right);
+    x->height = xleft > xright ? xleft + 1: xright + 1;
+
+    return x;
+}
+
+/* double rotation to the left and right */
+tree rotLR(tree h)
+{
+    if(h == NULL)
+        return h;
+    h->left = rotL(h->left);
+    return rotR(h);
+}
+
+/* double rotation to the right and left */
+tree rotRL(tree h)
+{
+    if(h == NULL)
+        return h;
+    h->right = rotR(h->right);
+    return rotL(h);
+}
+
+/* balance factor */
+int balance(tree h)
+{
+    if(h == NULL)
+        return 0;
+    return height(h->left) - height(h->right);
+}
+
+/* balances the tree */
+tree AVLbalance(tree h)
+{
+    int balance_factor, hleft, hright;
+
+    if(h == NULL)
+        return h;
+    balance_factor = balance(h);
+
+    if(balance_factor > 1) {
+        if(balance(h->left) >= 0)
+            h = rotR(h);
+        else
+            h = rotLR(h);
+    }
+    else if(balance_factor < -1) {
+        if(balance(h->right) <= 0)
+            h = rotL(h);
+        else
+            h = rotRL(h);
+    }
+    else {
+        hleft = height(h->left);
+        hright = height(h->right);
+        h->height = hleft > hright ? hleft + 1: hright + 1;
+    }
+    return h;
+}
+
+/* searchs for the Path named by the length chars of name in the tree with
+head h, returns NULL if the Path isn't in the tree */
+tree search_tree(tree h, const char *name, int length)
+{
+    int cmp;
+
+    if(h == NULL)
+        return NULL;
+
+    cmp = compare_names(name, length, h->path->name, h->path->length);
+    if(cmp == 0)
+        return h;
+
+    if(cmp > 0)
+        return search_tree(h->left, name, length);
+
+    else
+        return search_tree(h->right, name, length);
+}
+
+/* returns the Path of the node h that existed in version, NULL if none did */
+Path* path_at(tree h, long version)
+{
+    Path *path;
+
+    for(path = h->path; path != NULL && !visible(path, version);
+        path = path->older);
+    return path;
+}
+
+/* returns the first Path in alphabetical order whose name doesn't come before
+the length chars of key (that comes after key if strict is TRUE) in the tree
+with head h, NULL if there's none, the paths that come after are on the left
+of each node */
+tree lower_bound(tree h, const char *key, int length, int strict)
+{
+    tree found = NULL;
+    int cmp;
+
+    while(h != NULL) {
+        cmp = compare_names(h->path->name, h->path->length, key, length);
+
+        if(cmp > 0 || (cmp == 0 && !strict)) {
+            found = h;
+            h = h->right;
+        }
+        else
+            h = h->left;
+    }
+    return found;
+}
+
+/* inserts a new Path in the tree with head h */
+tree insert(tree h, Path *path)
+{
+    if(h == NULL)
+        return new_h(path, NULL, NULL);
+
+    if(compare_names(path->name, path->length,
+                     h->path->name, h->path->length) > 0)
+        h->left = insert(h->left, path);
+
+    else
+        h->right = insert(h->right, path);
+    h = AVLbalance(h);
+    return h;
+}
+
+/* returns the subtree with max value from the tree with head h */
+tree max(tree h)
+{
+    while(h != NULL && h->right != NULL)
+        h = h->right;
+
+    return h;
+}
+
+/* returns the subtree with minimum value from the tree with head h */
+tree min(tree h)
+{
+    while(h != NULL && h->left != NULL)
+        h = h->left;
+
+    return h;
+}
+
+/* removes and deletes the node of the Path named by the length chars
+of name from the tree with head h */
+tree delete_tree(tree h, const char *name, int length)
+{
+    tree aux;
+    int cmp;
+
+    if(h == NULL) return h;
+    cmp = compare_names(name, length, h->path->name, h->path->length);
+    if(cmp > 0)  h->left = delete_tree(h->left, name, length);
+    else if(cmp < 0)  h->right = delete_tree(h->right, name, length);
+    else {
+        if(h->left != NULL && h->right != NULL) {
+            Path *x = h->path;
+            aux = max(h->left);
+            h->path = aux->path;
+            aux->path = x;
+            h->left = delete_tree(h->left, aux->path->name,
+                                  aux->path->length); }
+        else {
+            aux = h;
+            if(h->left == NULL && h->right == NULL) h = NULL;
+            else if(h->left == NULL) h = h->right;
+            else h = h->left;
+            free(aux); }
+    }
+    h = AVLbalance(h);
+    return h;
+}
+
+/* frees the nodes of the tree with head h but not its paths */
+void free_tree(tree h)
+{
+    if(h == NULL)
+        return;
+
+    free_tree(h->left);
+    free_tree(h->right);
+    free(h);
+}
+
+/* a version of the store pinned by the iterations created while it was the
+current one, the snapshots of a store are kept from the oldest to the newest */
+typedef struct snapshot {
+    long version;
+    int readers;
+    struct snapshot *next, *previous;
+} snapshot;
+
+/* a change whose old state is kept only for the snapshots, a path that
+was deleted or moved away, or a path whose value was replaced if deleted
+is FALSE */
+typedef struct retired {
+    Path *path;
+    long version;
+    int deleted;
+    struct retired *next;
+} retired;
+
+struct watcher;
+struct follower;
+
+/* a subscriber that watches a path, with the function it gets the changes of
+its values through, the watcher of the path, whose subscriptions are in a list,
+and the follower of the subscriber, whose subscriptions are in another list */
+typedef struct subscription {
+    store_listener *listener;
+    struct follower *owner;
+    struct watcher *watched;
+    struct subscription *next, *previous;
+    struct subscription *next_owned, *previous_owned;
+} subscription;
+
+/* a subscriber of a store, with its subscriptions, the last change it was
+notified of, so that it's notified once of each change, and the next follower
+in its bucket of the table of followers */
+typedef struct follower {
+    void *subscriber;
+    subscription *subscriptions;
+    long notified;
+    struct follower *next_hashed;
+} follower;
+
+/* a name of the trie of the paths that are watched, below the watcher of the
+names before it, with the subscriptions to the path it ends, the number of
+watchers below it and the next watcher in its bucket of the table of watchers,
+a watcher is kept while it has subscriptions or watchers below it */
+typedef struct watcher {
+    char *name;
+    int length;
+    unsigned long hash;
+    struct watcher *parent, *next_hashed;
+    subscription *subscriptions;
+    int children;
+} watcher;
+
+/* a store keeps its paths in a hierarchy of directories below its root, whose
+counters are the totals of the store, and their values in a value_table, every
+change to it makes a new version, and the changes whose old state is kept for
+the pinned snapshots are queued, in the order of their versions, to be undone
+once no snapshot sees it, trail holds the paths from the root to the last path
+looked up, and dirs, paths and chars count the directories and paths below the
+root that are in memory, which clones share, and the length of their names,
+above its budget of memory the directories looked up the longest ago are
+written to its spill file, with about the bytes of it no path reads back
+anymore, the bytes it had when it was last rewritten and a set of the grams of
+the values in it, so that a search of the values can tell it has no need to
+read it back, and clock counts its
+lookups, the newest path with each name in each directory is also in a hash
+table of names, so that a path is looked up with one hash and one compare for
+each of its names, the paths that are watched make a trie of watchers, whose
+names are in a hash table too, and route and event hold the watchers on the
+way to the path whose value changed and that path, while subscriptions counts
+the subscriptions, which are also kept by subscriber in a table of followers,
+and notifications counts the changes notified, the paths whose subpaths are
+in the spill file are listed, so that a search reads them back without walking
+the store, and linked numbers the paths in the order they're added to their
+directories */
+struct store {
+    Path *root;
+    value_table *values;
+    long version, dirs, paths, chars;
+    snapshot *oldest, *newest;
+    retired *first_retired, *last_retired;
+    Path **trail;
+    int trail_size;
+    long budget, clock, hits, misses, spills;
+    FILE *spill_file;
+    long spill_dead, spill_live;
+    unsigned char *spilled_grams;
+    Path *first_spilled, *last_spilled;
+    long linked;
+    Path **buckets;
+    long num_buckets, num_hashed;
+    watcher *watching, **watchers, **route;
+    long num_watchers, num_watched, subscriptions;
+    follower **followers;
+    long num_followers, num_following, notifications;
+    char *event;
+    long route_size, event_size;
+};
+
+/* returns TRUE if a snapshot of the store s sees the changes up to version */
+int pinned(store *s, long version)
+{
+    return s->newest != NULL && s->newest->version >= version;
+}
+
+/* returns a snapshot of the current version of the store s */
+snapshot* pin(store *s)
+{
+    snapshot *snap = s->newest;
+
+    if(snap != NULL && snap->version == s->version) {
+        snap->readers++;
+        return snap;
+    }
+    snap = malloc(sizeof(snapshot));
+    snap->version = s->version;
+    snap->readers = 1;
+    snap->next = NULL;
+    snap->previous = s->newest;
+    if(s->newest != NULL)
+        s->newest->next = snap;
+    else
+        s->oldest = snap;
+    s->newest = snap;
+    return snap;
+}
+
+/* queues the change of the Path path made in the current version of the
+store s, whose old state is kept for the snapshots */
+void retire(store *s, Path *path, int deleted)
+{
+    retired *r = malloc(sizeof(retired));
+
+    r->path = path;
+    r->version = s->version;
+    r->deleted = deleted;
+    r->next = NULL;
+    path->queued++;
+    if(s->last_retired != NULL)
+        s->last_retired->next = r;
+    else
+        s->first_retired = r;
+    s->last_retired = r;
+}
+
+/* returns the bucket of the table of names of the store s
+for the name with hash hash in the directory dir */
+Path** bucket(store *s, Dir *dir, unsigned long hash)
+{
+    return &s->buckets[(hash ^ ((unsigned long) dir >> 4)) % s->num_buckets];
+}
+
+/* returns the newest Path named by the length chars of name in the
+directory dir of the store s, NULL if there's none */
+Path* lookup_name(store *s, Dir *dir, const char *name, int length)
+{
+    unsigned long hash = hash_value(name, length);
+    Path *path;
+
+    for(path = *bucket(s, dir, hash); path != NULL; path = path->next_hashed)
+        if(path->hash == hash && path->in == dir && path->length == length &&
+           memcmp(path->name, name, length) == 0)
+            return path;
+    return NULL;
+}
+
+/* adds the Path path, now the newest with its name in its directory,
+to the table of names of the store s */
+void hash_path(store *s, Path *path)
+{
+    Path **buckets = s->buckets, **link, *next;
+    long i, num_buckets = s->num_buckets;
+
+    if(++s->num_hashed > num_buckets) {
+        s->num_buckets *= 2;
+        s->buckets = calloc(s->num_buckets, sizeof(Path*));
+        for(i = 0; i < num_buckets; i++)
+            for(; buckets[i] != NULL; buckets[i] = next) {
+                next = buckets[i]->next_hashed;
+                link = bucket(s, buckets[i]->in, buckets[i]->hash);
+                buckets[i]->next_hashed = *link;
+                *link = buckets[i];
+            }
+        free(buckets);
+    }
+    link = bucket(s, path->in, path->hash);
+    path->next_hashed = *link;
+    *link = path;
+}
+
+/* removes the Path path from the table of names of the store s,
+if it's there */
+void unhash_path(store *s, Path *path)
+{
+    Path **link = bucket(s, path->in, path->hash);
+
+    while(*link != NULL && *link != path)
+        link = &(*link)->next_hashed;
+    if(*link != NULL) {
+        *link = path->next_hashed;
+        path->next_hashed = NULL;
+        s->num_hashed--;
+    }
+}
+
+/* makes dir, NULL for none, the directory of the Path path, moving it from
+the list of the paths that hold its old directory to the list of dir, without
+changing the references to either one */
+void hold_dir(Path *path, Dir *dir)
+{
+    if(path->dir != NULL) {
+        if(path->previous_sharer != NULL)
+            path->previous_sharer->next_sharer = path->next_sharer;
+        else
+            path->dir->sharers = path->next_sharer;
+        if(path->next_sharer != NULL)
+            path->next_sharer->previous_sharer = path->previous_sharer;
+    }
+    path->dir = dir;
+    path->previous_sharer = NULL;
+    path->next_sharer = dir != NULL ? dir->sharers : NULL;
+    if(dir != NULL) {
+        if(dir->sharers != NULL)
+            dir->sharers->previous_sharer = path;
+        dir->sharers = path;
+    }
+}
+
+/* sets where the subpaths of the Path path were written in the spill file of
+the store s, NOT_SPILLED if they're in memory, adding it to the end of the list
+of the spilled paths or removing it from there */
+void set_spill(store *s, Path *path, long spill)
+{
+    if(path->spill != NOT_SPILLED && spill == NOT_SPILLED) {
+        if(path->previous_spilled != NULL)
+            path->previous_spilled->next_spilled = path->next_spilled;
+        else
+            s->first_spilled = path->next_spilled;
+        if(path->next_spilled != NULL)
+            path->next_spilled->previous_spilled = path->previous_spilled;
+        else
+            s->last_spilled = path->previous_spilled;
+        path->next_spilled = path->previous_spilled = NULL;
+    }
+    else if(path->spill == NOT_SPILLED && spill != NOT_SPILLED) {
+        path->previous_spilled = s->last_spilled;
+        if(s->last_spilled != NULL)
+            s->last_spilled->next_spilled = path;
+        else
+            s->first_spilled = path;
+        s->last_spilled = path;
+    }
+    path->spill = spill;
+}
+
+/* adds the Path path to the directory of the Path parent in the store s, as
+its last subpath, in front of the deleted paths with the same name that are
+kept for snapshots at the node dead of its tree, if there are any */
+void link_path(store *s, Path *parent, Path *path, tree dead)
+{
+    Dir *dir = parent->dir;
+
+    if(dir == NULL) {
+        dir = malloc(sizeof(Dir));
+        PROFILE_EVENT(EV_ALLOC);
+        dir->names = NULL;
+        dir->first = dir->last = NULL;
+        dir->refs = 1;
+        dir->sharers = NULL;
+        hold_dir(parent, dir);
+        s->dirs++;
+    }
+    path->in = dir;
+    path->order = ++s->linked;
+    if(dead != NULL) {
+        unhash_path(s, dead->path);
+        path->older = dead->path;
+        dead->path = path;
+    }
+    else
+        dir->names = insert(dir->names, path);
+    hash_path(s, path);
+
+    path->next = NULL;
+    path->previous = dir->last;
+    if(dir->last != NULL)
+        dir->last->next = path;
+    else
+        dir->first = path;
+    dir->last = path;
+}
+
+/* removes the Path path from its directory in the store s, and its node
+from the tree of the directory if no other path with its name is kept */
+void unlink_path(store *s, Path *path)
+{
+    Dir *dir = path->in;
+    tree h = search_tree(dir->names, path->name, path->length);
+    Path **link = &h->path;
+
+    if(h->path == path) {
+        unhash_path(s, path);
+        if(path->older != NULL)
+            hash_path(s, path->older);
+    }
+    if(h->path == path && path->older == NULL)
+        dir->names = delete_tree(dir->names, path->name, path->length);
+    else {
+        while(*link != path)
+            link = &(*link)->older;
+        *link = path->older;
+    }
+    if(path->previous != NULL)
+        path->previous->next = path->next;
+    else
+        dir->first = path->next;
+    if(path->next != NULL)
+        path->next->previous = path->previous;
+    else
+        dir->last = path->previous;
+    path->in = NULL;
+    path->older = NULL;
+}
+
+void drop_path(store *s, Path *path);
+
+/* drops a reference of a path of the store s to the directory dir,
+freeing it and the paths in it once no path holds it */
+void release_dir(store *s, Dir *dir)
+{
+    Path *path, *next;
+
+    if(dir == NULL || --dir->refs > 0)
+        return;
+    for(path = dir->first; path != NULL; path = next) {
+        next = path->next;
+        unhash_path(s, path);
+        path->in = NULL;
+        drop_path(s, path);
+    }
+    free_tree(dir->names);
+    free(dir);
+    s->dirs--;
+}
+
+long spilled_size(Path *path);
+
+/* frees the Path path of the store s, which is in no directory anymore, the
+subpaths it spilled are dead in the spill file */
+void forget_path(store *s, Path *path)
+{
+    if(path->spill != NOT_SPILLED) {
+        s->spill_dead += spilled_size(path);
+        set_spill(s, path, NOT_SPILLED);
+    }
+    s->paths--;
+    s->chars -= path->length;
+    free_path(path, s->values);
+}
+
+/* frees the Path path of the store s, which is in no directory anymore, with
+its subpaths, a path with queued changes is left for the last of them */
+void drop_path(store *s, Path *path)
+{
+    Dir *dir = path->dir;
+
+    hold_dir(path, NULL);
+    release_dir(s, dir);
+    if(path->queued == 0)
+        forget_path(s, path);
+}
+
+/* deletes the Path path, with its subpaths, from the store s, if a snapshot
+can still see it it's only marked as deleted and kept in its directory, its
+subpaths are hidden by it so they aren't marked */
+void delete_path(store *s, Path *path)
+{
+    if(!pinned(s, path->born)) {
+        unlink_path(s, path);
+        drop_path(s, path);
+        return;
+    }
+    path->died = s->version;
+    retire(s, path, TRUE);
+}
+
+/* returns a new path of the store s named by the length chars of name, with
+the value, directory and counters of the Path path, created in its current
+version */
+Path* copy_path(store *s, Path *path, const char *name, int length)
+{
+    Path *copy = mk_path(name, length, s->version);
+
+    s->paths++;
+    s->chars += length;
+    hold_value(copy, path->value);
+    if(copy->value != NULL)
+        copy->value->refs++;
+    hold_dir(copy, path->dir);
+    if(copy->dir != NULL)
+        copy->dir->refs++;
+    copy->subpaths = path->subpaths;
+    copy->bytes = path->bytes;
+    copy->chars = path->chars - path->length + length;
+    set_spill(s, copy, path->spill);
+    copy->touched = path->touched;
+    return copy;
+}
+
+/* gives the Path path, at level level of the trail of the store s, a copy of
+the directory it shares, with copies of its paths that share their own
+directories, so that a change only copies the directories on its way, if a
+snapshot can still see the path it's kept as deleted with the shared directory
+and replaced by a copy right after it, returns the path that holds the copy */
+Path* unshare(store *s, Path *path, int level)
+{
+    Dir *shared = path->dir;
+    Path *copy, *child;
+    tree h;
+
+    if(pinned(s, path->born)) {
+        copy = copy_path(s, path, path->name, path->length);
+        h = search_tree(path->in->names, path->name, path->length);
+        copy->older = path;
+        h->path = copy;
+        copy->in = path->in;
+        copy->order = path->order;
+        unhash_path(s, path);
+        hash_path(s, copy);
+        copy->previous = path;
+        copy->next = path->next;
+        if(path->next != NULL)
+            path->next->previous = copy;
+        else
+            path->in->last = copy;
+        path->next = copy;
+        path->died = s->version;
+        retire(s, path, TRUE);
+        s->trail[level] = path = copy;
+    }
+    shared->refs--;
+    hold_dir(path, NULL);
+    for(child = shared->first; child != NULL; child = child->next)
+        if(child->died == 0)
+            link_path(s, path, copy_path(s, child, child->name, child->length),
+                      NULL);
+    return path;
+}
+
+/* frees what was kept of the changes that no snapshot of the store s sees,
+a path that was freed with its directory only waited for its queued changes */
+void sweep(store *s)
+{
+    long oldest = s->oldest != NULL ? s->oldest->version : s->version;
+    retired *r;
+    Path *path;
+
+    while((r = s->first_retired) != NULL && r->version <= oldest) {
+        path = r->path;
+        path->queued--;
+        if(path->in == NULL) {
+            if(path->queued == 0)
+                forget_path(s, path);
+        }
+        else if(r->deleted) {
+            unlink_path(s, path);
+            drop_path(s, path);
+        }
+        else
+            trim_history(path, oldest, s->values);
+        s->first_retired = r->next;
+        free(r);
+    }
+    if(s->first_retired == NULL)
+        s->last_retired = NULL;
+}
+
+/* releases the snapshot snap of the store s, once it has no readers
+the paths and values only it could see are freed */
+void unpin(store *s, snapshot *snap)
+{
+    if(--snap->readers > 0)
+        return;
+    if(snap->previous != NULL)
+        snap->previous->next = snap->next;
+    else
+        s->oldest = snap->next;
+    if(snap->next != NULL)
+        snap->next->previous = snap->previous;
+    else
+        s->newest = snap->previous;
+    free(snap);
+    sweep(s);
+}
+
+/* how a path is written in the spill file, followed by its name and its
+value, with where its own subpaths were written */
+typedef struct {
+    int length, value_length, subpaths;
+    long bytes, chars, born, since, spill;
+} spilled;
+
+/* a path whose subpaths may be spilled, with the last time it or one of its
+subpaths was looked up and the number of directories it is below the root */
+typedef struct {
+    Path *path;
+    long touched;
+    int depth;
+} candidate;
+
+/* the candidates of a store for spilling */
+typedef struct {
+    candidate *all;
+    int used, size;
+} candidate_list;
+
+/* the paths of a directory read back from the spill file, count, with their
+names and values one after the other in chars, and the bytes it takes in it */
+typedef struct {
+    int count;
+    spilled *records;
+    char *chars;
+    long length;
+} spilled_dir;
+
+/* where the directories of the old spill file of a store are written in the
+new one, in a hash table of size slots, NOT_SPILLED in from if they're free */
+typedef struct {
+    long *from, *to;
+    long used, size;
+} spill_map;
+
+/* fills the keys, values and index of info with the memory the names of the
+paths of the store s, its values and its indexes take, without the room kept
+for more of them, which is the memory its budget limits */
+void count_memory(store *s, store_info *info)
+{
+    value_table *values = s->values;
+
+    info->keys = s->chars;
+    info->values = sizeof(value_table) +
+                   values->num_buckets * (long) sizeof(Value*) +
+                   values->num_values * (long) sizeof(Value) +
+                   values->heap_used - values->heap_wasted;
+    info->index = sizeof(store) + s->dirs * (long) sizeof(Dir) +
+                  s->num_buckets * (long) sizeof(Path*) +
+                  s->paths * (long) (sizeof(Path) + sizeof(struct treenode)) +
+                  index_memory(values->index) +
+                  (s->spilled_grams != NULL ? SPILLED_GRAMS / CHAR_BIT : 0);
+}
+
+/* returns the memory the paths and values of the store s take */
+long memory_used(store *s)
+{
+    store_info info;
+
+    count_memory(s, &info);
+    return info.keys + info.values + info.index;
+}
+
+/* returns about the bytes the subpaths of the Path path take in the spill
+file, from its counters */
+long spilled_size(Path *path)
+{
+    return path->subpaths * (long) sizeof(spilled) + path->chars -
+           path->length + path->bytes -
+           (path->value != NULL ? path->value->length : 0);
+}
+
+/* returns the bit of the set of grams of the spilled values of a store for
+the n chars, at most three, of chars */
+unsigned long gram_bit(const char *chars, int n)
+{
+    unsigned long gram = n;
+    int i;
+
+    for(i = 0; i < n; i++)
+        gram = gram << 8 | (unsigned char) chars[i];
+    return (gram * 2654435761UL >> 8) % SPILLED_GRAMS;
+}
+
+/* adds the grams of one, two and three chars of the length chars of chars,
+a value written to a spill file, to the set of grams grams */
+void mark_grams(unsigned char *grams, const char *chars, int length)
+{
+    unsigned long bit;
+    int i, n;
+
+    for(i = 0; i < length; i++)
+        for(n = 1; n <= 3 && i + n <= length; n++) {
+            bit = gram_bit(chars + i, n);
+            grams[bit / CHAR_BIT] |= 1 << bit % CHAR_BIT;
+        }
+}
+
+/* returns TRUE if a value in the spill file of the store s may start with or
+contain the length chars of part, which isn't empty, which it can't unless
+the grams of part, of three chars or of all of them if it's shorter, are all
+in the set of grams of the spilled values */
+int may_be_spilled(store *s, const char *part, int length)
+{
+    unsigned long bit;
+    int i, n = length < 3 ? length : 3;
+
+    if(s->spilled_grams == NULL)
+        return FALSE;
+    for(i = 0; i + n <= length; i++) {
+        bit = gram_bit(part + i, n);
+        if(!(s->spilled_grams[bit / CHAR_BIT] & 1 << bit % CHAR_BIT))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* writes the directory dir to the end of the spill file file, returns where
+it starts, a failed write is left in the error of file */
+long write_spilled(FILE *file, spilled_dir *dir)
+{
+    long start, at = 0;
+    int i;
+
+    fseek(file, 0, SEEK_END);
+    start = ftell(file);
+    fwrite(&dir->count, sizeof(int), 1, file);
+    for(i = 0; i < dir->count; i++) {
+        fwrite(&dir->records[i], sizeof(spilled), 1, file);
+        fwrite(dir->chars + at, 1, dir->records[i].length, file);
+        at += dir->records[i].length;
+        if(dir->records[i].value_length > 0) {
+            fwrite(dir->chars + at, 1, dir->records[i].value_length, file);
+            at += dir->records[i].value_length;
+        }
+    }
+    return start;
+}
+
+/* reads the directory written at start of the spill file file to dir,
+returns FALSE if it can't be read whole */
+int read_spilled(FILE *file, long start, spilled_dir *dir)
+{
+    spilled *record;
+    long at = 0, size = 0;
+    int i, ok;
+
+    dir->records = NULL;
+    dir->chars = NULL;
+    ok = fseek(file, start, SEEK_SET) == 0 &&
+         fread(&dir->count, sizeof(int), 1, file) == 1 && dir->count >= 0;
+    if(ok)
+        dir->records = malloc((dir->count + 1) * sizeof(spilled));
+    for(i = 0; ok && i < dir->count; i++) {
+        record = &dir->records[i];
+        ok = fread(record, sizeof(spilled), 1, file) == 1 &&
+             record->length >= 0 && record->value_length >= -1;
+        if(!ok)
+            break;
+        if(at + record->length + record->value_length + 1 > size) {
+            size = 2 * (at + record->length + record->value_length + 1);
+            dir->chars = realloc(dir->chars, size);
+        }
+        ok = fread(dir->chars + at, 1, record->length, file) ==
+             (size_t) record->length;
+        at += record->length;
+        if(ok && record->value_length > 0) {
+            ok = fread(dir->chars + at, 1, record->value_length, file) ==
+                 (size_t) record->value_length;
+            at += record->value_length;
+        }
+    }
+    if(!ok || ferror(file)) {
+        clearerr(file);
+        free(dir->records);
+        free(dir->chars);
+        return FALSE;
+    }
+    dir->length = ftell(file) - start;
+    return TRUE;
+}
+
+/* writes the paths of the directory dir to the end of the spill file of the
+store s, after the directories below them, returns where they start */
+long spill_dir(store *s, Dir *dir)
+{
+    spilled_dir written;
+    spilled *record;
+    Path *path;
+    long start, size = 0, at = 0;
+    int i = 0;
+
+    written.count = 0;
+    for(path = dir->first; path != NULL; path = path->next) {
+        written.count++;
+        size += path->length +
+                (path->value != NULL ? path->value->length : 0);
+    }
+    written.records = malloc((written.count + 1) * sizeof(spilled));
+    written.chars = malloc(size + 1);
+    for(path = dir->first; path != NULL; path = path->next, i++) {
+        record = &written.records[i];
+        record->length = path->length;
+        record->value_length = path->value != NULL ? path->value->length : -1;
+        record->subpaths = path->subpaths;
+        record->bytes = path->bytes;
+        record->chars = path->chars;
+        record->born = path->born;
+        record->since = path->since;
+        record->spill = path->dir != NULL ? spill_dir(s, path->dir)
+                                          : path->spill;
+        memcpy(written.chars + at, path->name, path->length);
+        at += path->length;
+        if(path->value != NULL) {
+            memcpy(written.chars + at, s->values->heap + path->value->offset,
+                   path->value->length);
+            mark_grams(s->spilled_grams, written.chars + at,
+                       path->value->length);
+            at += path->value->length;
+        }
+    }
+    start = write_spilled(s->spill_file, &written);
+    free(written.records);
+    free(written.chars);
+    s->spills++;
+    return start;
+}
+
+/* reads back the subpaths of the Path path of the store s from where
+spill_dir wrote them, leaving the directories below them in the file, if they
+can't be read whole path is left spilled, to be read again when it's next
+looked up, and FALSE is returned */
+int load_dir(store *s, Path *path)
+{
+    spilled_dir read;
+    spilled *record;
+    Path *loaded;
+    char *chars;
+    int i;
+
+    if(!read_spilled(s->spill_file, path->spill, &read))
+        return FALSE;
+    chars = read.chars;
+    for(i = 0; i < read.count; i++) {
+        record = &read.records[i];
+        loaded = mk_path(chars, record->length, record->born);
+        chars += record->length;
+        if(record->value_length >= 0) {
+            hold_value(loaded, intern_value(s->values, chars,
+                                            record->value_length,
+                                            hash_value(chars,
+                                                       record->value_length)));
+            chars += record->value_length;
+        }
+        loaded->since = record->since;
+        loaded->subpaths = record->subpaths;
+        loaded->bytes = record->bytes;
+        loaded->chars = record->chars;
+        set_spill(s, loaded, record->spill);
+        loaded->touched = s->clock;
+        link_path(s, path, loaded, NULL);
+        s->paths++;
+        s->chars += record->length;
+    }
+    set_spill(s, path, NOT_SPILLED);
+    s->spill_dead += read.length;
+    free(read.records);
+    free(read.chars);
+    return TRUE;
+}
+
+/* returns the slot of map where the directory at from is, or the free slot
+where it goes */
+long map_slot(spill_map *map, long from)
+{
+    long i = (long) (((unsigned long) from * 2654435761UL) &
+                     (unsigned long) (map->size - 1));
+
+    while(map->from[i] != NOT_SPILLED && map->from[i] != from)
+        i = (i + 1) & (map->size - 1);
+    return i;
+}
+
+/* adds to map that the directory at from is now at to, doubling it when it
+gets half full, its entries being moved to their slots in the larger map
+without being counted again */
+void map_spill(spill_map *map, long from, long to)
+{
+    long *old_from = map->from, *old_to = map->to, old_size = map->size, i, j;
+
+    if(2 * (map->used + 1) > map->size) {
+        map->size *= 2;
+        map->from = malloc(map->size * sizeof(long));
+        map->to = malloc(map->size * sizeof(long));
+        for(i = 0; i < map->size; i++)
+            map->from[i] = NOT_SPILLED;
+        for(i = 0; i < old_size; i++)
+            if(old_from[i] != NOT_SPILLED) {
+                j = map_slot(map, old_from[i]);
+                map->from[j] = old_from[i];
+                map->to[j] = old_to[i];
+            }
+        free(old_from);
+        free(old_to);
+    }
+    i = map_slot(map, from);
+    if(map->from[i] == NOT_SPILLED)
+        map->used++;
+    map->from[i] = from;
+    map->to[i] = to;
+}
+
+/* copies the directory at *offset of the spill file of the store s, and the
+ones below it, to the file to, if they aren't there yet, adding the grams of
+their values to grams, and points offset to where it is in it, returns FALSE
+if it can't be read */
+int copy_spilled(store *s, FILE *to, unsigned char *grams, spill_map *map,
+                 long *offset)
+{
+    spilled_dir read;
+    spilled *record;
+    char *chars;
+    long i = map_slot(map, *offset);
+    int j, ok = TRUE;
+
+    if(map->from[i] == *offset) {
+        *offset = map->to[i];
+        return TRUE;
+    }
+    if(!read_spilled(s->spill_file, *offset, &read))
+        return FALSE;
+    for(j = 0, chars = read.chars; ok && j < read.count; j++) {
+        record = &read.records[j];
+        chars += record->length;
+        if(record->value_length > 0) {
+            mark_grams(grams, chars, record->value_length);
+            chars += record->value_length;
+        }
+        if(record->spill != NOT_SPILLED)
+            ok = copy_spilled(s, to, grams, map, &record->spill);
+    }
+    if(ok) {
+        map_spill(map, *offset, write_spilled(to, &read));
+        *offset = map->to[map_slot(map, *offset)];
+    }
+    free(read.records);
+    free(read.chars);
+    return ok;
+}
+
+/* copies the directories spilled below the directory dir of the store s to
+the file to, as copy_spilled does, a directory shared by clones is marked
+while it's walked, with its refs made negative, so that it's copied only once,
+returns FALSE if one can't be read */
+int copy_dir(store *s, Dir *dir, FILE *to, unsigned char *grams,
+             spill_map *map)
+{
+    Path *path;
+    long offset;
+    int ok = TRUE;
+
+    if(dir->refs < 0)
+        return TRUE;
+    if(dir->refs > 1)
+        dir->refs = -dir->refs;
+    for(path = dir->first; ok && path != NULL; path = path->next)
+        if(path->dir != NULL)
+            ok = copy_dir(s, path->dir, to, grams, map);
+        else if(path->spill != NOT_SPILLED) {
+            offset = path->spill;
+            ok = copy_spilled(s, to, grams, map, &offset);
+        }
+    return ok;
+}
+
+/* unmarks the directories below the directory dir that copy_dir marked and,
+if moved is TRUE, points the paths in them to where their subpaths were
+copied */
+void unmark_dir(Dir *dir, spill_map *map, int moved)
+{
+    Path *path;
+
+    if(dir->refs > 1)
+        return;
+    if(dir->refs < 0)
+        dir->refs = -dir->refs;
+    for(path = dir->first; path != NULL; path = path->next)
+        if(path->dir != NULL)
+            unmark_dir(path->dir, map, moved);
+        else if(path->spill != NOT_SPILLED && moved)
+            path->spill = map->to[map_slot(map, path->spill)];
+}
+
+/* rewrites the spill file of the store s with only the directories its paths
+can still read back, and its set of grams with only their values, once about
+half of it is dead and it's twice as large as when it was last rewritten, so
+that each byte written to it is copied about once, it's kept if the new file
+can't be written */
+void compact_spill(store *s)
+{
+    FILE *to;
+    unsigned char *grams;
+    spill_map map;
+    long size, i;
+    int ok;
+
+    fseek(s->spill_file, 0, SEEK_END);
+    size = ftell(s->spill_file);
+    if(s->spill_dead <= size / 2 || size <= 2 * s->spill_live ||
+       (to = tmpfile()) == NULL)
+        return;
+    map.size = 64;
+    map.used = 0;
+    map.from = malloc(map.size * sizeof(long));
+    map.to = malloc(map.size * sizeof(long));
+    for(i = 0; i < map.size; i++)
+        map.from[i] = NOT_SPILLED;
+    grams = calloc(SPILLED_GRAMS / CHAR_BIT, 1);
+    ok = copy_dir(s, s->root->dir, to, grams, &map) && fflush(to) == 0 &&
+         !ferror(to);
+    unmark_dir(s->root->dir, &map, ok);
+    if(ok) {
+        fclose(s->spill_file);
+        s->spill_file = to;
+        free(s->spilled_grams);
+        s->spilled_grams = grams;
+        fseek(to, 0, SEEK_END);
+        s->spill_live = ftell(to);
+        s->spill_dead = 0;
+    }
+    else {
+        fclose(to);
+        free(grams);
+    }
+    free(map.from);
+    free(map.to);
+}
+
+/* returns the directory of the Path path of the store s, reading it back from
+the spill file if it was written there, NULL if path has no subpaths or they
+can't be read back */
+Dir* dir_of(store *s, Path *path)
+{
+    if(path->dir != NULL)
+        s->hits++;
+    else if(path->spill != NOT_SPILLED) {
+        s->misses++;
+        load_dir(s, path);
+    }
+    return path->dir;
+}
+
+/* adds to list the paths below the Path path, which is depth directories
+below the root and has a directory in memory, whose directories are in memory
+and only theirs, returns the last time path or one of its subpaths was looked
+up, which is never before the same time of its subpaths */
+long find_candidates(Path *path, int depth, candidate_list *list)
+{
+    long touched = path->touched, last;
+    Path *child;
+
+    for(child = path->dir->first; child != NULL; child = child->next) {
+        last = child->touched;
+        if(child->dir != NULL && child->dir->refs == 1) {
+            last = find_candidates(child, depth + 1, list);
+            if(list->used == list->size) {
+                list->size *= 2;
+                list->all = realloc(list->all,
+                                    list->size * sizeof(candidate));
+            }
+            list->all[list->used].path = child;
+            list->all[list->used].touched = last;
+            list->all[list->used++].depth = depth + 1;
+        }
+        if(last > touched)
+            touched = last;
+    }
+    return touched;
+}
+
+/* compares the candidates c1 and c2 by the last time they were looked up and
+then by how deep they are, so that a path comes after its subpaths */
+int compare_candidates(const void *c1, const void *c2)
+{
+    const candidate *candidate1 = c1, *candidate2 = c2;
+
+    if(candidate1->touched != candidate2->touched)
+        return candidate1->touched < candidate2->touched ? -1 : 1;
+    return candidate2->depth - candidate1->depth;
+}
+
+/* spills the directories of the store s that were looked up the longest ago
+until the memory it takes is an eighth below its budget, if it's above it,
+only while no snapshot is pinned, so that no iteration holds the paths that
+are freed */
+void fit_budget(store *s)
+{
+    candidate_list list;
+    Path *path;
+    Dir *dir;
+    long start, target = s->budget - s->budget / 8;
+    int i;
+
+    if(s->budget <= 0 || s->oldest != NULL || s->root->dir == NULL ||
+       memory_used(s) <= s->budget)
+        return;
+    if(s->spill_file == NULL) {
+        if((s->spill_file = tmpfile()) == NULL)
+            return;
+        s->spilled_grams = calloc(SPILLED_GRAMS / CHAR_BIT, 1);
+    }
+    compact_spill(s);
+    list.size = 64;
+    list.used = 0;
+    list.all = malloc(list.size * sizeof(candidate));
+    find_candidates(s->root, 0, &list);
+    qsort(list.all, list.used, sizeof(candidate), compare_candidates);
+    for(i = 0; i < list.used && memory_used(s) > target; i++) {
+        path = list.all[i].path;
+        start = spill_dir(s, path->dir);
+        if(fflush(s->spill_file) != 0 || ferror(s->spill_file)) {
+            clearerr(s->spill_file);
+            break; /* the file is full, the paths stay in memory */
+        }
+        set_spill(s, path, start);
+        dir = path->dir;
+        hold_dir(path, NULL);
+        release_dir(s, dir);
+    }
+    free(list.all);
+}
+
+/* makes room in the trail of the store s for the paths of a path of length
+chars, which has at most one name in every two chars */
+void grow_trail(store *s, size_t length)
+{
+    if((size_t) s->trail_size > length / 2 + 1)
+        return;
+    s->trail_size = length / 2 + 2;
+    s->trail = realloc(s->trail, s->trail_size * sizeof(Path*));
+}
+
+/* returns the length of the name of the length chars of path that starts at
+*i, or after the '/' at *i, moving *i past it, 0 if there are no more names */
+int next_name(const char *path, size_t length, size_t *i)
+{
+    size_t start;
+
+    for(; *i < length && path[*i] == '/'; (*i)++);
+    for(start = *i; *i < length && path[*i] != '/'; (*i)++);
+    return *i - start;
+}
+
+/* returns the number of names of path, which are looked up one directory at a
+time from the root of the store s and whose paths are left in its trail, or -1
+if path isn't in the store */
+int find_path(store *s, const char *path, size_t length)
+{
+    Path *dir = s->root;
+    size_t i = 0;
+    int n, depth = 0;
+
+    grow_trail(s, length);
+    s->clock++;
+    while((n = next_name(path, length, &i)) > 0) {
+        if(dir_of(s, dir) == NULL ||
+           (dir = lookup_name(s, dir->dir, path + i - n, n)) == NULL ||
+           dir->died != 0)
+            return -1;
+        s->trail[depth++] = dir;
+        dir->touched = s->clock;
+    }
+    return depth;
+}
+
+/* makes the directories of the first depth paths of the trail of the store s,
+which was just filled by find_path, only their own, so that they can be
+changed without changing a clone */
+void own_trail(store *s, int depth)
+{
+    Path *dir = s->root;
+    int i;
+
+    for(i = 0; i < depth; dir = s->trail[i++]) {
+        if(dir->dir->refs == 1)
+            continue;
+        dir = unshare(s, dir, i - 1);
+        s->trail[i] = lookup_name(s, dir->dir, s->trail[i]->name,
+                                  s->trail[i]->length);
+    }
+}
+
+/* adds subpaths, bytes and chars to the counters of the root of the store s
+and of the first depth paths of its trail */
+void add_stats(store *s, int depth, int subpaths, long bytes, long chars)
+{
+    Path *path;
+    int i;
+
+    for(i = 0; i <= depth; i++) {
+        path = i == 0 ? s->root : s->trail[i - 1];
+        path->subpaths += subpaths;
+        path->bytes += bytes;
+        path->chars += chars;
+    }
+}
+
+/* does the same as find_path but adds the paths that aren't in the store s
+yet, each one after the existing subpaths of its directory, and makes the
+directories on the way only their own as own_trail does, starting below the
+first depth paths of the trail, which hold the names before path[i] */
+int make_path(store *s, const char *path, size_t length, int depth, size_t i)
+{
+    Path *dir = depth > 0 ? s->trail[depth - 1] : s->root, *new_path, *found;
+    int n;
+
+    grow_trail(s, length);
+    s->clock++;
+    while((n = next_name(path, length, &i)) > 0) {
+        if(dir_of(s, dir) != NULL && dir->dir->refs > 1)
+            dir = unshare(s, dir, depth - 1);
+        found = dir->dir != NULL ? lookup_name(s, dir->dir, path + i - n, n)
+                                 : NULL;
+        if(found == NULL || found->died != 0) {
+            new_path = mk_path(path + i - n, n, s->version);
+            s->paths++;
+            s->chars += n;
+            link_path(s, dir, new_path, found == NULL ? NULL :
+                      search_tree(dir->dir->names, path + i - n, n));
+            add_stats(s, depth, 1, 0, n);
+            dir = new_path;
+        }
+        else
+            dir = found;
+        s->trail[depth++] = dir;
+        dir->touched = s->clock;
+    }
+    return depth;
+}
+
+/* returns the bucket of the table of watchers of the store s for the name
+with hash hash below the watcher parent */
+watcher** watcher_bucket(store *s, watcher *parent, unsigned long hash)
+{
+    return &s->watchers[(hash ^ ((unsigned long) parent >> 4)) %
+                        s->num_watchers];
+}
+
+/* returns the watcher named by the length chars of name below the watcher
+parent of the store s, NULL if there's none */
+watcher* child_watcher(store *s, watcher *parent, const char *name,
+                       int length)
+{
+    unsigned long hash = hash_value(name, length);
+    watcher *w;
+
+    for(w = *watcher_bucket(s, parent, hash); w != NULL; w = w->next_hashed)
+        if(w->hash == hash && w->parent == parent && w->length == length &&
+           memcmp(w->name, name, length) == 0)
+            return w;
+    return NULL;
+}
+
+/* returns a new watcher of the store s named by the length chars of name
+below the watcher parent */
+watcher* add_watcher(store *s, watcher *parent, const char *name, int length)
+{
+    watcher **old = s->watchers, **link, *w, *next;
+    long i, num_watchers = s->num_watchers;
+
+    if(++s->num_watched > num_watchers) {
+        s->num_watchers *= 2;
+        s->watchers = calloc(s->num_watchers, sizeof(watcher*));
+        for(i = 0; i < num_watchers; i++)
+            for(w = old[i]; w != NULL; w = next) {
+                next = w->next_hashed;
+                link = watcher_bucket(s, w->parent, w->hash);
+                w->next_hashed = *link;
+                *link = w;
+            }
+        free(old);
+    }
+    w = malloc(sizeof(watcher));
+    w->name = malloc(length + 1);
+    memcpy(w->name, name, length);
+    w->name[length] = '\0';
+    w->length = length;
+    w->hash = hash_value(name, length);
+    w->parent = parent;
+    w->next_hashed = NULL;
+    w->subscriptions = NULL;
+    w->children = 0;
+    if(parent != NULL) {
+        parent->children++;
+        link = watcher_bucket(s, parent, w->hash);
+        w->next_hashed = *link;
+        *link = w;
+    }
+    return w;
+}
+
+/* frees the watcher w of the store s and the watchers above it that are
+left with no subscriptions and no watchers below them, but not the root */
+void prune_watcher(store *s, watcher *w)
+{
+    watcher **link, *parent;
+
+    while(w->parent != NULL && w->subscriptions == NULL && w->children == 0) {
+        parent = w->parent;
+        for(link = watcher_bucket(s, parent, w->hash); *link != w;
+            link = &(*link)->next_hashed);
+        *link = w->next_hashed;
+        parent->children--;
+        s->num_watched--;
+        free(w->name);
+        free(w);
+        w = parent;
+    }
+}
+
+/* returns the bucket of the table of followers of the store s for
+subscriber */
+follower** follower_bucket(store *s, void *subscriber)
+{
+    return &s->followers[((unsigned long) subscriber >> 4) %
+                         s->num_followers];
+}
+
+/* returns the follower of subscriber in the store s, making it if there's
+none and add is TRUE, NULL if there's none otherwise */
+follower* find_follower(store *s, void *subscriber, int add)
+{
+    follower **old = s->followers, **link, *f, *next;
+    long i, num_followers = s->num_followers;
+
+    for(f = *follower_bucket(s, subscriber); f != NULL; f = f->next_hashed)
+        if(f->subscriber == subscriber)
+            return f;
+    if(!add)
+        return NULL;
+    if(++s->num_following > num_followers) {
+        s->num_followers *= 2;
+        s->followers = calloc(s->num_followers, sizeof(follower*));
+        for(i = 0; i < num_followers; i++)
+            for(f = old[i]; f != NULL; f = next) {
+                next = f->next_hashed;
+                link = follower_bucket(s, f->subscriber);
+                f->next_hashed = *link;
+                *link = f;
+            }
+        free(old);
+    }
+    f = malloc(sizeof(follower));
+    f->subscriber = subscriber;
+    f->subscriptions = NULL;
+    f->notified = 0;
+    link = follower_bucket(s, subscriber);
+    f->next_hashed = *link;
+    *link = f;
+    return f;
+}
+
+/* adds a subscription of the follower owner to the watcher w of the store s,
+with listener */
+void add_subscription(store *s, watcher *w, follower *owner,
+                      store_listener *listener)
+{
+    subscription *sub = malloc(sizeof(subscription));
+
+    sub->listener = listener;
+    sub->owner = owner;
+    sub->watched = w;
+    sub->previous = NULL;
+    if((sub->next = w->subscriptions) != NULL)
+        sub->next->previous = sub;
+    w->subscriptions = sub;
+    sub->previous_owned = NULL;
+    if((sub->next_owned = owner->subscriptions) != NULL)
+        sub->next_owned->previous_owned = sub;
+    owner->subscriptions = sub;
+    s->subscriptions++;
+}
+
+/* removes the subscription sub from the store s, with its follower if it has
+no other subscriptions, but not the watcher it's in */
+void remove_subscription(store *s, subscription *sub)
+{
+    follower *owner = sub->owner, **link;
+
+    if(sub->previous != NULL)
+        sub->previous->next = sub->next;
+    else
+        sub->watched->subscriptions = sub->next;
+    if(sub->next != NULL)
+        sub->next->previous = sub->previous;
+    if(sub->previous_owned != NULL)
+        sub->previous_owned->next_owned = sub->next_owned;
+    else
+        owner->subscriptions = sub->next_owned;
+    if(sub->next_owned != NULL)
+        sub->next_owned->previous_owned = sub->previous_owned;
+    free(sub);
+    s->subscriptions--;
+
+    if(owner->subscriptions != NULL)
+        return;
+    for(link = follower_bucket(s, owner->subscriber); *link != owner;
+        link = &(*link)->next_hashed);
+    *link = owner->next_hashed;
+    s->num_following--;
+    free(owner);
+}
+
+/* makes room in the route and the event of the store s for the watchers
+of depth names and a path of length chars */
+void grow_route(store *s, int depth, long length)
+{
+    if(depth >= s->route_size) {
+        s->route_size = 2 * depth + 1;
+        s->route = realloc(s->route, s->route_size * sizeof(watcher*));
+    }
+    if(length > s->event_size) {
+        s->event_size = 2 * length;
+        s->event = realloc(s->event, s->event_size);
+    }
+}
+
+/* adds the Path path, at level depth of the route of the store s, to it,
+after the path of length chars above it, returns the length of its path */
+long add_to_route(store *s, Path *path, int depth, long length)
+{
+    watcher *above = s->route[depth - 1];
+
+    grow_route(s, depth, length + 1 + path->length);
+    s->route[depth] = above != NULL ? child_watcher(s, above, path->name,
+                                                    path->length) : NULL;
+    s->event[length] = '/';
+    memcpy(s->event + length + 1, path->name, path->length);
+    return length + 1 + path->length;
+}
+
+/* fills the route and the event of the store s with the first depth paths of
+its trail, returns the length of their path */
+long route_trail(store *s, int depth)
+{
+    long length = 0;
+    int i;
+
+    grow_route(s, 0, 0);
+    s->route[0] = s->watching;
+    for(i = 1; i <= depth; i++)
+        length = add_to_route(s, s->trail[i - 1], i, length);
+    return length;
+}
+
+/* calls the listener of every subscriber that watches the path of the first
+depth names of the route of the store s, whose length is length, or a path
+it's a subpath of, with the change of its value from old_value to new_value,
+once for each subscriber, at the deepest path it watches, as the deepest
+watchers are seen first and each follower keeps the last change it got */
+void notify_path(store *s, int depth, long length, Value *old_value,
+                 Value *new_value)
+{
+    const char *heap = s->values->heap;
+    subscription *sub;
+    long change = ++s->notifications;
+    int i;
+
+    for(i = depth; i >= 0; i--) {
+        if(s->route[i] == NULL)
+            continue;
+        for(sub = s->route[i]->subscriptions; sub != NULL; sub = sub->next) {
+            if(sub->owner->notified == change)
+                continue;
+            sub->owner->notified = change;
+            sub->listener(sub->owner->subscriber, s->event, length,
+                old_value != NULL ? heap + old_value->offset : NULL,
+                old_value != NULL ? old_value->length : 0,
+                new_value != NULL ? heap + new_value->offset : NULL,
+                new_value != NULL ? new_value->length : 0);
+        }
+    }
+}
+
+/* notifies, as notify_path does, the change of the value of the Path path, at
+level depth of the route of the store s, and of the values of its subpaths,
+which were removed if removed is TRUE or added otherwise, only going below
+path if a subscriber watches it or a path it's a subpath of, given by
+watched, or a path below it */
+void notify_subpaths(store *s, Path *path, int depth, long length,
+                     int removed, int watched)
+{
+    Path *child;
+    watcher *w;
+    long child_length;
+
+    if(watched && path->value != NULL)
+        notify_path(s, depth, length, removed ? path->value : NULL,
+                    removed ? NULL : path->value);
+    if(!watched && s->route[depth] == NULL)
+        return;
+    if(dir_of(s, path) == NULL)
+        return;
+    for(child = path->dir->first; child != NULL; child = child->next) {
+        if(child->died != 0)
+            continue;
+        child_length = add_to_route(s, child, depth + 1, length);
+        w = s->route[depth + 1];
+        notify_subpaths(s, child, depth + 1, child_length, removed,
+                        watched || (w != NULL && w->subscriptions != NULL));
+    }
+}
+
+/* notifies, as notify_subpaths does, the change of the value of the path at
+level depth - 1 of the trail of the store s, or of the root if depth is 0,
+and of its subpaths, if anything is watched */
+void notify_trail(store *s, int depth, int removed)
+{
+    long length;
+    int i, watched = FALSE;
+
+    if(s->subscriptions == 0)
+        return;
+    length = route_trail(s, depth);
+    for(i = 0; i <= depth; i++)
+        if(s->route[i] != NULL && s->route[i]->subscriptions != NULL)
+            watched = TRUE;
+    notify_subpaths(s, depth > 0 ? s->trail[depth - 1] : s->root, depth,
+                    length, removed, watched);
+}
+
+/* returns a new empty store */
+store* store_open()
+{
+    store *s = malloc(sizeof(store));
+
+    s->root = mk_path("", 0, 0);
+    s->values = mk_value_table();
+    s->version = 0;
+    s->dirs = s->paths = s->chars = 0;
+    s->oldest = s->newest = NULL;
+    s->first_retired = s->last_retired = NULL;
+    s->trail_size = 64;
+    s->trail = malloc(s->trail_size * sizeof(Path*));
+    s->budget = s->clock = 0;
+    s->hits = s->misses = s->spills = 0;
+    s->spill_file = NULL;
+    s->spill_dead = s->spill_live = 0;
+    s->spilled_grams = NULL;
+    s->first_spilled = s->last_spilled = NULL;
+    s->linked = 0;
+    s->num_buckets = INIT_BUCKETS;
+    s->num_hashed = 0;
+    s->buckets = calloc(s->num_buckets, sizeof(Path*));
+    s->num_watchers = INIT_WATCHERS;
+    s->num_watched = s->subscriptions = 0;
+    s->watchers = calloc(s->num_watchers, sizeof(watcher*));
+    s->watching = add_watcher(s, NULL, "", 0);
+    s->num_followers = INIT_WATCHERS;
+    s->num_following = s->notifications = 0;
+    s->followers = calloc(s->num_followers, sizeof(follower*));
+    s->route_size = s->event_size = 0;
+    s->route = NULL;
+    s->event = NULL;
+
+    return s;
+}
+
+/* frees the watcher w and its subscriptions */
+void free_watcher(watcher *w)
+{
+    subscription *sub;
+
+    while((sub = w->subscriptions) != NULL) {
+        w->subscriptions = sub->next;
+        free(sub);
+    }
+    free(w->name);
+    free(w);
+}
+
+/* frees the followers of the store s */
+void free_followers(store *s)
+{
+    follower *f;
+    long i;
+
+    for(i = 0; i < s->num_followers; i++)
+        while((f = s->followers[i]) != NULL) {
+            s->followers[i] = f->next_hashed;
+            free(f);
+        }
+    free(s->followers);
+}
+
+/* frees the store s and everything in it */
+void store_close(store *s)
+{
+    watcher *w;
+    retired *r;
+    long i;
+
+    while((r = s->first_retired) != NULL) {
+        s->first_retired = r->next;
+        if(--r->path->queued == 0 && r->path->in == NULL)
+            free_path(r->path, s->values);
+        free(r);
+    }
+    drop_path(s, s->root);
+    free_value_table(s->values);
+    free(s->trail);
+    free(s->buckets);
+    for(i = 0; i < s->num_watchers; i++)
+        while((w = s->watchers[i]) != NULL) {
+            s->watchers[i] = w->next_hashed;
+            free_watcher(w);
+        }
+    free_watcher(s->watching);
+    free(s->watchers);
+    free_followers(s);
+    free(s->route);
+    free(s->event);
+    if(s->spill_file != NULL)
+        fclose(s->spill_file);
+    free(s->spilled_grams);
+    free(s);
+}
+
+/* keeps the value of the Path path, which is being replaced,
+for the snapshots of the store s that still see it */
+void keep_value(store *s, Path *path)
+{
+    old_value *old = malloc(sizeof(old_value));
+
+    old->value = path->value;
+    old->since = path->since;
+    old->next = path->history;
+    path->history = old;
+    retire(s, path, FALSE);
+}
+
+/* stores the Value new_value at path, which isn't the root, in the current
+version of the store s, making it as make_path does from depth and i */
+void set_value(store *s, const char *path, size_t length, int depth, size_t i,
+               Value *new_value)
+{
+    Path *old;
+    Value *dropped = NULL;
+    int old_length;
+
+    depth = make_path(s, path, length, depth, i);
+    old = s->trail[depth - 1];
+    old_length = old->value != NULL ? old->value->length : 0;
+    add_stats(s, depth, 0, new_value->length - old_length, 0);
+    if(s->subscriptions > 0 && old->value != new_value)
+        notify_path(s, depth, route_trail(s, depth), old->value, new_value);
+    if(pinned(s, old->since))
+        keep_value(s, old);
+    else
+        dropped = old->value;
+    hold_value(old, new_value);
+    release_value(s->values, dropped);
+    old->since = s->version;
+}
+
+/* stores value at path, creating the path and the paths it is a subpath of
+that don't exist yet, returns STORE_INVALID if path is the root */
+int store_set(store *s, const char *path, size_t path_length,
+              const char *value, size_t value_length)
+{
+    Value *new_value;
+
+    if(store_is_root(path, path_length))
+        return STORE_INVALID;
+    new_value = intern_value(s->values, value, value_length,
+                             hash_value(value, value_length));
+
+    s->version++;
+    set_value(s, path, path_length, 0, 0, new_value);
+    fit_budget(s);
+    return STORE_OK;
+}
+
+/* points value and value_length to the value stored at path, returns
+STORE_NOT_FOUND or STORE_NO_DATA if it has none */
+int store_get(store *s, const char *path, size_t path_length,
+              const char **value, size_t *value_length)
+{
+    int depth = find_path(s, path, path_length);
+    Path *found;
+
+    if(depth <= 0)
+        return STORE_NOT_FOUND;
+    found = s->trail[depth - 1];
+    if(found->value == NULL)
+        return STORE_NO_DATA;
+
+    *value = s->values->heap + found->value->offset;
+    *value_length = found->value->length;
+    fit_budget(s);
+    return STORE_OK;
+}
+
+/* deletes the path at level depth - 1 of the trail of the store s, which was
+just filled by find_path, in its current version */
+void remove_path(store *s, int depth)
+{
+    Path *deleted;
+
+    notify_trail(s, depth, TRUE);
+    own_trail(s, depth);
+    deleted = s->trail[depth - 1];
+    add_stats(s, depth - 1, -(deleted->subpaths + 1), -deleted->bytes,
+              -deleted->chars);
+    delete_path(s, deleted);
+}
+
+/* deletes path and all its subpaths, which are in its directory and so go
+with it, returns STORE_NOT_FOUND if it isn't in the store */
+int store_delete(store *s, const char *path, size_t path_length)
+{
+    int depth = find_path(s, path, path_length);
+
+    if(depth <= 0)
+        return STORE_NOT_FOUND;
+    s->version++;
+    remove_path(s, depth);
+    fit_budget(s);
+    return STORE_OK;
+}
+
+/* checks that the path from of the store s can be moved or cloned to the path
+to, returns STORE_NOT_FOUND if from isn't in the store, STORE_EXISTS if to is,
+STORE_INVALID if from or to is the root or to is a subpath of from, and
+STORE_OK otherwise, with from at level depth - 1 of the trail */
+int check_target(store *s, const char *from, size_t from_length,
+                 const char *to, size_t to_length, int *depth)
+{
+    Path *path, *dir = s->root, *found;
+    size_t i = 0;
+    int n = 0;
+
+    if((*depth = find_path(s, from, from_length)) < 0)
+        return STORE_NOT_FOUND;
+    if(*depth == 0 || store_is_root(to, to_length))
+        return STORE_INVALID;
+    path = s->trail[*depth - 1];
+    while(dir != path && (n = next_name(to, to_length, &i)) > 0 &&
+          dir_of(s, dir) != NULL &&
+          (found = lookup_name(s, dir->dir, to + i - n, n)) != NULL &&
+          found->died == 0)
+        dir = found;
+    if(dir == path)
+        return STORE_INVALID;
+    return n == 0 ? STORE_EXISTS : STORE_OK;
+}
+
+/* returns the length of the last name of the length chars of path,
+which isn't the root, and points start to where it starts */
+int last_name(const char *path, size_t length, size_t *start)
+{
+    size_t end;
+
+    for(end = length; path[end - 1] == '/'; end--);
+    for(*start = end; *start > 0 && path[*start - 1] != '/'; (*start)--);
+    return end - *start;
+}
+
+/* adds the Path path, which is in no directory and has the last name of the
+path to, to the store s at to, whose first start chars are the paths above
+it, creating the ones that don't exist yet */
+void add_at(store *s, Path *path, const char *to, size_t start)
+{
+    int depth = make_path(s, to, start, 0, 0);
+    Path *dir = depth > 0 ? s->trail[depth - 1] : s->root;
+    tree h;
+
+    if(dir_of(s, dir) != NULL && dir->dir->refs > 1)
+        dir = unshare(s, dir, depth - 1);
+    h = dir->dir != NULL ? search_tree(dir->dir->names, path->name,
+                                       path->length) : NULL;
+    link_path(s, dir, path, h);
+    add_stats(s, depth, path->subpaths + 1, path->bytes, path->chars);
+}
+
+/* moves the path from, with all its subpaths, to the path to, creating the
+paths to is a subpath of that don't exist yet, since subpaths don't store the
+names above them only the path from is relinked, or, if a snapshot can still
+see it, copied to to while it's kept at from as deleted, sharing its directory
+with the copy, returns the same as check_target */
+int store_move(store *s, const char *from, size_t from_length,
+               const char *to, size_t to_length)
+{
+    Path *path, *moved;
+    size_t start;
+    int n, depth, result;
+
+    result = check_target(s, from, from_length, to, to_length, &depth);
+    if(result != STORE_OK)
+        return result;
+
+    s->version++;
+    notify_trail(s, depth, TRUE);
+    own_trail(s, depth);
+    path = s->trail[depth - 1];
+    add_stats(s, depth - 1, -(path->subpaths + 1), -path->bytes,
+              -path->chars);
+    n = last_name(to, to_length, &start);
+    if(pinned(s, path->born)) {
+        moved = copy_path(s, path, to + start, n);
+        path->died = s->version;
+        retire(s, path, TRUE);
+    }
+    else {
+        unlink_path(s, path);
+        free(path->name);
+        path->name = malloc(n + 1);
+        memcpy(path->name, to + start, n);
+        s->chars += n - path->length;
+        path->chars += n - path->length;
+        path->length = n;
+        path->hash = hash_value(path->name, n);
+        path->born = s->version;
+        moved = path;
+    }
+    add_at(s, moved, to, start);
+    if(s->subscriptions > 0)
+        notify_trail(s, find_path(s, to, to_length), FALSE);
+    fit_budget(s);
+    return STORE_OK;
+}
+
+/* clones the path from, with all its subpaths, to the path to, creating the
+paths to is a subpath of that don't exist yet, the clone shares the directory
+and the value of from, so it costs the same whatever the number of subpaths,
+until either one is changed, returns the same as check_target */
+int store_clone(store *s, const char *from, size_t from_length,
+                const char *to, size_t to_length)
+{
+    size_t start;
+    int n, depth, result;
+
+    result = check_target(s, from, from_length, to, to_length, &depth);
+    if(result != STORE_OK)
+        return result;
+
+    s->version++;
+    n = last_name(to, to_length, &start);
+    add_at(s, copy_path(s, s->trail[depth - 1], to + start, n), to, start);
+    if(s->subscriptions > 0)
+        notify_trail(s, find_path(s, to, to_length), FALSE);
+    fit_budget(s);
+    return STORE_OK;
+}
+
+/* deletes every path of the store s in its current version, one directory
+below the root at a time only if some of them must be kept for its snapshots */
+void clear_paths(store *s)
+{
+    Path *root = s->root, *path, *next;
+    Dir *dir;
+
+    if(root->dir == NULL)
+        return;
+    notify_trail(s, 0, TRUE);
+    if(s->oldest == NULL) {
+        dir = root->dir;
+        hold_dir(root, NULL);
+        release_dir(s, dir);
+    }
+    else {
+        for(path = root->dir->first; path != NULL; path = next) {
+            next = path->next;
+            if(path->died == 0)
+                delete_path(s, path);
+        }
+    }
+    root->subpaths = 0;
+    root->bytes = 0;
+    root->chars = 0;
+}
+
+/* deletes every path of the store s */
+void store_clear(store *s)
+{
+    if(s->root->dir == NULL)
+        return;
+    s->version++;
+    clear_paths(s);
+}
+
+/* a change of a transaction, that sets the value of value_length chars at
+value, or deletes if value is negative, the path of path_length chars at path,
+both given as positions in the chars of the transaction, with the path
+normalized so that the paths of its changes can be compared */
+typedef struct {
+    long path, value;
+    int path_length, value_length;
+} change;
+
+/* the changes of a transaction in the order they were made */
+struct store_txn {
+    change *changes;
+    int used, size;
+    char *chars;
+    long chars_used, chars_size;
+};
+
+/* the chars of the transaction whose changes are being sorted */
+const char *sorted_chars;
+
+/* returns a new empty transaction */
+store_txn* store_begin()
+{
+    store_txn *t = malloc(sizeof(store_txn));
+
+    t->size = 16;
+    t->used = 0;
+    t->changes = malloc(t->size * sizeof(change));
+    t->chars_size = INIT_HEAP;
+    t->chars_used = 0;
+    t->chars = malloc(t->chars_size);
+    return t;
+}
+
+/* adds length chars to the chars of the transaction t */
+void add_chars(store_txn *t, const char *chars, size_t length)
+{
+    if(t->chars_used + (long) length > t->chars_size) {
+        while(t->chars_used + (long) length > t->chars_size)
+            t->chars_size *= 2;
+        t->chars = realloc(t->chars, t->chars_size);
+    }
+    memcpy(t->chars + t->chars_used, chars, length);
+    t->chars_used += length;
+}
+
+/* adds to the transaction t a change of path, kept as its names each after
+a '/', that sets the value of value_length chars, or deletes if value is
+NULL */
+void add_change(store_txn *t, const char *path, size_t path_length,
+                const char *value, size_t value_length)
+{
+    change *c;
+    size_t i = 0;
+    int n;
+
+    if(t->used == t->size) {
+        t->size *= 2;
+        t->changes = realloc(t->changes, t->size * sizeof(change));
+    }
+    c = &t->changes[t->used++];
+    c->path = t->chars_used;
+    while((n = next_name(path, path_length, &i)) > 0) {
+        add_chars(t, "/", 1);
+        add_chars(t, path + i - n, n);
+    }
+    c->path_length = t->chars_used - c->path;
+    c->value = value != NULL ? t->chars_used : -1;
+    c->value_length = value_length;
+    if(value != NULL)
+        add_chars(t, value, value_length);
+}
+
+/* adds to the transaction t the change of storing value at path, returns
+STORE_INVALID, without adding it, if path is the root */
+int store_txn_set(store_txn *t, const char *path, size_t path_length,
+                  const char *value, size_t value_length)
+{
+    if(store_is_root(path, path_length))
+        return STORE_INVALID;
+    add_change(t, path, path_length, value, value_length);
+    return STORE_OK;
+}
+
+/* adds to the transaction t the deletion of path, or of every path if path
+is the root */
+void store_txn_delete(store_txn *t, const char *path, size_t path_length)
+{
+    add_change(t, path, path_length, NULL, 0);
+}
+
+/* compares the changes c1 and c2 by their paths, and, for the same path, by
+the order they were made in, so that the last value set is kept */
+int compare_changes(const void *c1, const void *c2)
+{
+    const change *change1 = c1, *change2 = c2;
+    int length = change1->path_length < change2->path_length ?
+                 change1->path_length : change2->path_length;
+    int cmp = memcmp(sorted_chars + change1->path,
+                     sorted_chars + change2->path, length);
+
+    if(cmp == 0)
+        cmp = change1->path_length - change2->path_length;
+    if(cmp == 0)
+        cmp = change1->path < change2->path ? -1 : 1;
+    return cmp;
+}
+
+/* returns the number of names the normalized paths path1 and path2, of
+length1 and length2 chars, start with, pointing i to where the rest of path1
+starts */
+int shared_names(const char *path1, size_t length1,
+                 const char *path2, size_t length2, size_t *i)
+{
+    size_t j;
+    int names = 0;
+
+    *i = 0;
+    for(j = 0; j < length1 && j < length2 && path1[j] == path2[j]; j++)
+        if(j > 0 && path1[j] == '/') {
+            names++;
+            *i = j;
+        }
+    if(j > *i && (j == length1 || path1[j] == '/') &&
+       (j == length2 || path2[j] == '/')) {
+        names++;
+        *i = j;
+    }
+    return names;
+}
+
+/* applies the changes of the transaction t from first to last, which all
+set values, to the store s, in the order of their paths, so that each one only
+looks up the names it doesn't share with the one before, which are left in
+the trail */
+void set_sorted(store *s, store_txn *t, int first, int last)
+{
+    change *c, *previous = NULL;
+    const char *path;
+    Value *value;
+    size_t i = 0;
+    int depth = 0;
+
+    sorted_chars = t->chars;
+    qsort(t->changes + first, last - first, sizeof(change), compare_changes);
+    for(c = t->changes + first; c < t->changes + last; previous = c++) {
+        path = t->chars + c->path;
+        if(previous != NULL)
+            depth = shared_names(path, c->path_length,
+                                 t->chars + previous->path,
+                                 previous->path_length, &i);
+        value = intern_value(s->values, t->chars + c->value, c->value_length,
+                             hash_value(t->chars + c->value,
+                                        c->value_length));
+        set_value(s, path, c->path_length, depth, i, value);
+    }
+}
+
+/* frees the transaction t without applying its changes */
+void store_abort(store_txn *t)
+{
+    free(t->changes);
+    free(t->chars);
+    free(t);
+}
+
+/* applies the changes of the transaction t to the store s all in the same
+version, so that no iteration sees only some of them, and frees it, the
+changes between two deletions are sorted by path, returns the number of
+deletions whose path wasn't in the store */
+int store_commit(store *s, store_txn *t)
+{
+    change *c;
+    int first, last, depth, missing = 0;
+
+    if(t->used > 0)
+        s->version++;
+    for(first = 0; first < t->used; first = last) {
+        for(last = first; last < t->used && t->changes[last].value >= 0;
+            last++);
+        if(last > first) {
+            set_sorted(s, t, first, last);
+            continue;
+        }
+        c = &t->changes[last++];
+        if(c->path_length == 0)
+            clear_paths(s);
+        else if((depth = find_path(s, t->chars + c->path,
+                                   c->path_length)) > 0)
+            remove_path(s, depth);
+        else
+            missing++;
+    }
+    store_abort(t);
+    fit_budget(s);
+    return missing;
+}
+
+/* returns TRUE if path stands for the root and FALSE otherwise */
+int store_is_root(const char *path, size_t length)
+{
+    size_t i;
+
+    for(i = 0; i < length; i++)
+        if(path[i] != '/')
+            return FALSE;
+    return TRUE;
+}
+
+/* fills info with the number of subpaths of path and the size of their values,
+kept up to date by set, delete and move so that it costs a single lookup, and
+with the memory used by the store if path is the root */
+int store_stats(store *s, const char *path, size_t path_length,
+                store_info *info)
+{
+    Path *found = s->root;
+    int depth;
+
+    fit_budget(s);
+    memset(info, 0, sizeof(store_info));
+    if(!store_is_root(path, path_length)) {
+        if((depth = find_path(s, path, path_length)) < 0)
+            return STORE_NOT_FOUND;
+        found = s->trail[depth - 1];
+        info->subpaths = found->subpaths;
+        info->bytes = found->bytes;
+        return STORE_OK;
+    }
+    info->subpaths = found->subpaths;
+    info->bytes = found->bytes;
+    count_memory(s, info);
+    info->budget = s->budget;
+    info->hits = s->hits;
+    info->misses = s->misses;
+    info->spills = s->spills;
+    return STORE_OK;
+}
+
+/* limits the memory the paths and values of the store s take to budget bytes,
+or lifts the limit if budget is 0 */
+void store_set_budget(store *s, long budget)
+{
+    s->budget = budget;
+    fit_budget(s);
+}
+
+/* makes subscriber watch path and its subpaths, whose changes are given to
+listener, watching a path again only changes its listener */
+void store_watch(store *s, const char *path, size_t path_length,
+                 store_listener *listener, void *subscriber)
+{
+    watcher *w = s->watching, *child;
+    subscription *sub;
+    size_t i = 0;
+    int n;
+
+    while((n = next_name(path, path_length, &i)) > 0) {
+        if((child = child_watcher(s, w, path + i - n, n)) == NULL)
+            child = add_watcher(s, w, path + i - n, n);
+        w = child;
+    }
+    for(sub = w->subscriptions; sub != NULL; sub = sub->next)
+        if(sub->owner->subscriber == subscriber) {
+            sub->listener = listener;
+            return;
+        }
+    add_subscription(s, w, find_follower(s, subscriber, TRUE), listener);
+}
+
+/* makes subscriber stop watching path, returns STORE_NOT_FOUND if
+it doesn't watch it */
+int store_unwatch(store *s, const char *path, size_t path_length,
+                  void *subscriber)
+{
+    watcher *w = s->watching;
+    subscription *sub;
+    size_t i = 0;
+    int n;
+
+    while((n = next_name(path, path_length, &i)) > 0)
+        if((w = child_watcher(s, w, path + i - n, n)) == NULL)
+            return STORE_NOT_FOUND;
+    for(sub = w->subscriptions; sub != NULL; sub = sub->next)
+        if(sub->owner->subscriber == subscriber) {
+            remove_subscription(s, sub);
+            prune_watcher(s, w);
+            return STORE_OK;
+        }
+    return STORE_NOT_FOUND;
+}
+
+/* makes subscriber stop watching every path it watches, through the list of
+its subscriptions, freeing the watchers left with nothing on the way up from
+each of them */
+void store_unwatch_all(store *s, void *subscriber)
+{
+    follower *f;
+    watcher *w;
+
+    while((f = find_follower(s, subscriber, FALSE)) != NULL) {
+        w = f->subscriptions->watched;
+        remove_subscription(s, f->subscriptions);
+        prune_watcher(s, w);
+    }
+}
+
+/* returns TRUE if the name of length chars matches the directory of the glob
+pattern that starts at pattern, where '*' matches any sequence of chars and
+'?' any single char, FALSE otherwise */
+int match_name(const char *pattern, const char *name, int length)
+{
+    if(*pattern == '\0' || *pattern == '/')
+        return length == 0;
+    if(*pattern == '*')
+        return match_name(pattern + 1, name, length) ||
+               (length > 0 && match_name(pattern, name + 1, length - 1));
+    if(length == 0)
+        return FALSE;
+    if(*pattern == '?' || *pattern == *name)
+        return match_name(pattern + 1, name + 1, length - 1);
+    return FALSE;
+}
+
+enum {ITER_WALK, ITER_SEARCH, ITER_PREFIX, ITER_SUBSTRING, ITER_LIST,
+      ITER_SCAN};
+
+/* a path found by a search, whose paths from the root down to it, length of
+them, are at start of the paths the search found */
+typedef struct {
+    long start;
+    int length;
+} found_path;
+
+/* an iteration over the paths of a store as they were in the version of its
+snapshot, which is at the path on top of its stack, above the paths it is a
+subpath of up to the directory dir, walking them from the root in the order
+of print, or listing or scanning the subpaths of dir through ordered
+searches for key, the path after it if strict is TRUE, relative to dir, the
+paths it returns start with the description of dir, its first prefix chars,
+since the paths don't store it, and the stack is kept even though the paths
+have no link to their directory, as a directory may be moved while a snapshot
+still sees it at its old place, a search finds all its paths when it's made,
+keeping the paths from the root down to each of them in found, one after the
+other, and where each one starts in results, in the order of print */
+struct store_iter {
+    store *s;
+    snapshot *snap;
+    int kind, started;
+    Path **stack;
+    int n, stack_size;
+    Path *dir;
+    char *key;
+    int key_length, key_size, strict, depth;
+    char *pattern;
+    Path **found;
+    long found_used, found_size;
+    found_path *results;
+    long num_results, results_size, next_result;
+    char *path; /* chars of the last path returned */
+    size_t path_size, prefix;
+};
+
+/* adds a '/' and the name of the Path path to the length chars of the last
+path returned by the iteration it, returns the new length */
+size_t add_name(store_iter *it, size_t length, Path *path)
+{
+    while(length + path->length + 1 > it->path_size) {
+        it->path_size *= 2;
+        it->path = realloc(it->path, it->path_size);
+    }
+    it->path[length] = '/';
+    memcpy(it->path + length + 1, path->name, path->length);
+    return length + path->length + 1;
+}
+
+/* returns a new iteration of the given kind over the paths of the store s,
+below the path at depth depth of its trail, or its root if depth is 0 */
+store_iter* mk_iter(store *s, int kind, int depth)
+{
+    store_iter *it = malloc(sizeof(store_iter));
+    int i;
+
+    it->s = s;
+    it->snap = pin(s);
+    it->kind = kind;
+    it->started = FALSE;
+    it->stack_size = 16;
+    it->stack = malloc(it->stack_size * sizeof(Path*));
+    it->n = 0;
+    it->dir = depth > 0 ? s->trail[depth - 1] : s->root;
+    it->key_size = 64;
+    it->key = malloc(it->key_size);
+    it->key_length = 0;
+    it->strict = FALSE;
+    it->depth = 0;
+    it->pattern = NULL;
+    it->found = NULL;
+    it->found_used = it->found_size = 0;
+    it->results = NULL;
+    it->num_results = it->results_size = it->next_result = 0;
+    it->path_size = 64;
+    it->path = malloc(it->path_size);
+    it->prefix = 0;
+    for(i = 0; i < depth; i++)
+        it->prefix = add_name(it, it->prefix, s->trail[i]);
+
+    return it;
+}
+
+/* pushes the Path path to the stack of the iteration it */
+void push(store_iter *it, Path *path)
+{
+    if(it->n == it->stack_size) {
+        it->stack_size *= 2;
+        it->stack = realloc(it->stack, it->stack_size * sizeof(Path*));
+    }
+    it->stack[it->n++] = path;
+}
+
+/* adds the length chars to the key of the iteration it */
+void add_key(store_iter *it, const char *chars, int length)
+{
+    while(it->key_length + length > it->key_size) {
+        it->key_size *= 2;
+        it->key = realloc(it->key, it->key_size);
+    }
+    memcpy(it->key + it->key_length, chars, length);
+    it->key_length += length;
+}
+
+/* sets the key of the iteration it to the description of the path at the
+level n of its stack, relative to its directory */
+void set_key(store_iter *it, int n)
+{
+    int i;
+
+    it->key_length = 0;
+    for(i = 0; i < n; i++) {
+        if(i > 0)
+            add_key(it, "/", 1);
+        add_key(it, it->stack[i]->name, it->stack[i]->length);
+    }
+}
+
+/* returns the Path named by the length chars of name in the directory of the
+Path dir that the snapshot of the iteration it sees, NULL if there's none */
+Path* seen_path(store_iter *it, Path *dir, const char *name, int length)
+{
+    tree h;
+
+    if(dir_of(it->s, dir) == NULL ||
+       (h = search_tree(dir->dir->names, name, length)) == NULL)
+        return NULL;
+    return path_at(h, it->snap->version);
+}
+
+/* returns TRUE if the name of the Path path starts with the length chars of
+name followed by nothing or by a char that sorts before a '/', so that it
+comes before the subpaths of the path with that name, and FALSE otherwise */
+int extends(Path *path, const char *name, int length)
+{
+    return path != NULL && path->length >= length &&
+           memcmp(path->name, name, length) == 0 &&
+           (path->length == length || path->name[length] < '/');
+}
+
+/* pushes to the stack of the iteration it the first subpath of the Path dir,
+in the order of the descriptions relative to dir, that doesn't come before the
+length chars of key (that comes after if strict is TRUE) and that its snapshot
+sees, after the paths between them, returns FALSE if there's none, the paths
+named as the first directory of key, or as a part of it that's followed by a
+char that sorts before a '/', come before the next name, and so do their
+subpaths, unless that name extends theirs with such a char */
+int seek(store_iter *it, Path *dir, const char *key, int length, int strict)
+{
+    Path *after = NULL, *path;
+    tree h;
+    int first, i;
+
+    if(dir_of(it->s, dir) == NULL)
+        return FALSE;
+    for(first = 0; first < length && key[first] != '/'; first++);
+    for(h = lower_bound(dir->dir->names, key, length, TRUE);
+        h != NULL && (after = path_at(h, it->snap->version)) == NULL;
+        h = lower_bound(dir->dir->names, h->path->name, h->path->length,
+                        TRUE));
+
+    if((path = seen_path(it, dir, key, first)) != NULL) {
+        if(first == length && !strict) {
+            push(it, path);
+            return TRUE;
+        }
+        if(first < length || !extends(after, key, first)) {
+            push(it, path);
+            if(first < length ? seek(it, path, key + first + 1,
+                                     length - first - 1, strict)
+                              : seek(it, path, "", 0, FALSE))
+                return TRUE;
+            it->n--;
+        }
+    }
+    for(i = first - 1; i > 0; i--) {
+        if(key[i] >= '/')
+            continue;
+        if(extends(after, key, i))
+            break;
+        if((path = seen_path(it, dir, key, i)) != NULL) {
+            push(it, path);
+            if(seek(it, path, "", 0, FALSE))
+                return TRUE;
+            it->n--;
+        }
+    }
+    if(after == NULL)
+        return FALSE;
+    push(it, after);
+    return TRUE;
+}
+
+/* sets the key of the iteration it to the path from relative to the directory
+dir, returns FALSE if from isn't a subpath of dir */
+int relative_key(store_iter *it, const char *dir, size_t dir_length,
+                 const char *from, size_t from_length)
+{
+    size_t i = 0, j = 0;
+    int n, m;
+
+    while((n = next_name(dir, dir_length, &i)) > 0) {
+        m = next_name(from, from_length, &j);
+        if(m != n || memcmp(dir + i - n, from + j - m, n) != 0)
+            return FALSE;
+    }
+    while((m = next_name(from, from_length, &j)) > 0) {
+        if(it->key_length > 0)
+            add_key(it, "/", 1);
+        add_key(it, from + j - m, m);
+    }
+    return it->key_length > 0;
+}
+
+/* iterates, in alphabetical order, over the paths that are direct subpaths
+of dir, starting at the first one that doesn't come before from */
+store_iter* store_list(store *s, const char *dir, size_t dir_length,
+                       const char *from, size_t from_length)
+{
+    int depth = find_path(s, dir, dir_length);
+    store_iter *it;
+
+    if(s->root->subpaths == 0 || depth < 0)
+        return NULL;
+    it = mk_iter(s, ITER_LIST, depth);
+    if(!store_is_root(from, from_length) &&
+       !relative_key(it, dir, dir_length, from, from_length)) {
+        store_iter_free(it);
+        return NULL;
+    }
+    return it;
+}
+
+/* returns the next component of the directory listed by it, which only
+searches the tree of the directory, skipping the paths its snapshot doesn't
+see, the components come in the same order as their descriptions since their
+names follow the same '/' */
+Path* next_list(store_iter *it)
+{
+    Path *path;
+    tree h;
+
+    if(dir_of(it->s, it->dir) == NULL)
+        return NULL;
+    while((h = lower_bound(it->dir->dir->names, it->key, it->key_length,
+                           it->strict)) != NULL) {
+        it->key_length = 0;
+        add_key(it, h->path->name, h->path->length);
+        it->strict = TRUE;
+        if((path = path_at(h, it->snap->version)) != NULL) {
+            it->n = 0;
+            push(it, path);
+            return path;
+        }
+    }
+    return NULL;
+}
+
+/* copies the pattern in the length chars to a new string without its
+repeated, first and last '/' */
+char* read_pattern(const char *chars, size_t length)
+{
+    char *pattern = malloc(length + 1);
+    size_t i, j = 0;
+
+    for(i = 0; i < length; i++) {
+        if(chars[i] == '/' && (j == 0 || pattern[j - 1] == '/'))
+            continue;
+        pattern[j++] = chars[i];
+    }
+    if(j > 0 && pattern[j - 1] == '/')
+        j--;
+    pattern[j] = '\0';
+    return pattern;
+}
+
+/* iterates, in alphabetical order, over the paths with values below dir that
+are at most depth directories below it and match the glob pattern */
+store_iter* store_scan(store *s, const char *dir, size_t dir_length,
+                       int depth, const char *pattern, size_t pattern_length)
+{
+    int n = find_path(s, dir, dir_length);
+    store_iter *it;
+
+    if(depth < 0 || s->root->subpaths == 0 || n < 0)
+        return NULL;
+    it = mk_iter(s, ITER_SCAN, n);
+    it->depth = depth;
+    if(pattern_length > 0)
+        it->pattern = read_pattern(pattern, pattern_length);
+    return it;
+}
+
+/* returns the number of directories of the path on the stack of the iteration
+it that pass its depth limit (0 for no limit) and match the directories of its
+glob pattern (NULL for no pattern), if a directory fails the returned value is
+minus its number so that the caller can skip all of its subpaths */
+int check_subpath(store_iter *it)
+{
+    char *pattern = it->pattern;
+    Path *path;
+    int i;
+
+    for(i = 1; i <= it->n; i++) {
+        path = it->stack[i - 1];
+        if(it->depth != 0 && i > it->depth)
+            return -i;
+        if(pattern != NULL) {
+            if(*pattern == '\0' ||
+               !match_name(pattern, path->name, path->length))
+                return -i;
+            for(; *pattern != '\0' && *pattern != '/'; pattern++);
+            if(*pattern == '/')
+                pattern++;
+        }
+    }
+    if(pattern != NULL && *pattern != '\0')
+        return 0; /* shallower than the pattern */
+    return i - 1;
+}
+
+/* returns the next path scanned by it, found by an ordered search from its
+directory down, subpaths that can't match are skipped as a whole */
+Path* next_scan(store_iter *it)
+{
+    Path *path;
+    int checked;
+
+    for(;;) {
+        it->n = 0;
+        if(!seek(it, it->dir, it->key, it->key_length, it->strict))
+            return NULL;
+        checked = check_subpath(it);
+
+        /* when the path found is the directory that failed its subpaths are
+        skipped once they're reached, skipping them now would also skip the
+        paths that only extend its last directory, like /a-b after /a */
+        if(checked < 0 && -checked < it->n) {
+            set_key(it, -checked);
+            add_key(it, "/", 1);
+            it->key[it->key_length - 1] = AFTER_SLASH;
+            it->strict = FALSE;
+            continue;
+        }
+        set_key(it, it->n);
+        it->strict = TRUE;
+
+        path = it->stack[it->n - 1];
+        if(checked > 0 && value_at(path, it->snap->version) != NULL)
+            return path;
+    }
+}
+
+/* returns the first of the Path path and the paths after it in its directory
+that the snapshot of the iteration it sees, NULL if there's none */
+Path* first_seen(store_iter *it, Path *path)
+{
+    while(path != NULL && !visible(path, it->snap->version))
+        path = path->next;
+    return path;
+}
+
+/* moves the iteration it to the next path in the order of print that its
+snapshot sees, the first subpath of the path it's at or else the next path in
+the directory of the nearest path of its stack, returns FALSE at the end */
+int advance(store_iter *it)
+{
+    Path *path = it->stack[it->n - 1], *next;
+
+    if(dir_of(it->s, path) != NULL &&
+       (next = first_seen(it, path->dir->first)) != NULL) {
+        push(it, next);
+        return TRUE;
+    }
+    while(it->n > 0) {
+        path = it->stack[--it->n];
+        if((next = first_seen(it, path->next)) != NULL) {
+            push(it, next);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/* starts the iteration it, which walks the paths of its store, at the first
+path of the root */
+void start_root(store_iter *it)
+{
+    Path *first;
+
+    if(it->s->root->dir != NULL &&
+       (first = first_seen(it, it->s->root->dir->first)) != NULL)
+        push(it, first);
+}
+
+/* iterates over the paths with values in the order of print, starting at
+from, whose paths are taken from the trail of the lookup */
+store_iter* store_walk(store *s, const char *from, size_t from_length)
+{
+    store_iter *it;
+    int i, depth = 0;
+
+    if(!store_is_root(from, from_length) &&
+       (depth = find_path(s, from, from_length)) < 0)
+        return NULL;
+
+    it = mk_iter(s, ITER_WALK, 0);
+    if(depth == 0)
+        start_root(it);
+    for(i = 0; i < depth; i++)
+        push(it, s->trail[i]);
+    return it;
+}
+
+/* reads back the subpaths of every path of the store s that still exists and
+has them in the spill file, and the ones below them, so that a search finds
+the paths that hold the values written there, a path whose subpaths can't be
+read back is left spilled */
+void load_spilled(store *s)
+{
+    Path *path = s->first_spilled, *kept = NULL;
+
+    while(path != NULL) {
+        if(path->died == 0 && path->in != NULL)
+            dir_of(s, path);
+        /* the subpaths that are spilled too were added to the end */
+        if(path->spill != NOT_SPILLED)
+            kept = path;
+        path = kept != NULL ? kept->next_spilled : s->first_spilled;
+    }
+}
+
+/* adds to the search it every place where the Path path is in the store, the
+paths below it on the way to the path found being on the stack of it, which
+are the places below each path that still exists and holds its directory, or
+the place below the root if it's in the directory of the root */
+void add_places(store_iter *it, Path *path)
+{
+    Path *sharer;
+    int i;
+
+    if(path->died != 0 || path->in == NULL)
+        return;
+    push(it, path);
+    if(path->in == it->s->root->dir) {
+        if(it->found_used + it->n > it->found_size) {
+            it->found_size = 2 * (it->found_used + it->n);
+            it->found = realloc(it->found, it->found_size * sizeof(Path*));
+        }
+        if(it->num_results == it->results_size) {
+            it->results_size = 2 * it->results_size + 16;
+            it->results = realloc(it->results,
+                                  it->results_size * sizeof(found_path));
+        }
+        it->results[it->num_results].start = it->found_used;
+        it->results[it->num_results++].length = it->n;
+        for(i = it->n - 1; i >= 0; i--)
+            it->found[it->found_used++] = it->stack[i];
+    }
+    else
+        for(sharer = path->in->sharers; sharer != NULL;
+            sharer = sharer->next_sharer)
+            add_places(it, sharer);
+    it->n--;
+}
+
+/* the paths found by the search whose results compare_found sorts */
+Path **compared_found;
+
+/* compares the paths found by a search pointed to by found1 and found2 by the
+places in their directories of the first paths on their ways that differ,
+which are in the same directory, so that a path comes before its subpaths and
+they come in the order of print, for qsort */
+int compare_found(const void *found1, const void *found2)
+{
+    const found_path *f1 = found1, *f2 = found2;
+    Path **way1 = compared_found + f1->start,
+         **way2 = compared_found + f2->start;
+    int i;
+
+    for(i = 0; i < f1->length && i < f2->length; i++)
+        if(way1[i] != way2[i])
+            return way1[i]->order < way2[i]->order ? -1 : 1;
+    return f1->length - f2->length;
+}
+
+/* adds to the search it the places of the paths that hold the Value value,
+and sorts them with the ones it found before if sort is TRUE */
+void add_holders(store_iter *it, Value *value, int sort)
+{
+    Path *path;
+
+    for(path = value != NULL ? value->holders : NULL; path != NULL;
+        path = path->next_holder)
+        add_places(it, path);
+    if(sort && it->num_results > 1) {
+        compared_found = it->found;
+        qsort(it->results, it->num_results, sizeof(found_path),
+              compare_found);
+    }
+}
+
+/* iterates over the paths that hold value, since values are stored once
+two paths hold the same value only if they point to the same Value, and it
+keeps a list of them, which are found when the iteration is made, after the
+spilled paths are read back if the value may be in the spill file */
+store_iter* store_search(store *s, const char *value, size_t value_length)
+{
+    store_iter *it = mk_iter(s, ITER_SEARCH, 0);
+
+    if(value_length == 0)
+        return it;
+    if(may_be_spilled(s, value, value_length))
+        load_spilled(s);
+    add_holders(it, lookup_value(s->values, value, value_length,
+                                 hash_value(value, value_length)), TRUE);
+    return it;
+}
+
+/* returns a search of the kind kind for the paths of the store s whose values
+start with, or contain, the length chars of part, which finds the values in
+the index of the values, after the spilled paths are read back if the spilled
+values may have part, and the paths through the lists of the paths that hold
+each value */
+store_iter* search_part(store *s, int kind, const char *part, size_t length)
+{
+    store_iter *it = mk_iter(s, kind, 0);
+    value_list found;
+    int i;
+
+    if(length == 0)
+        return it;
+    if(may_be_spilled(s, part, length))
+        load_spilled(s);
+    found.all = NULL;
+    found.used = found.size = 0;
+    find_values(s->values, part, length, kind == ITER_PREFIX, &found);
+    for(i = 0; i < found.used; i++)
+        add_holders(it, found.all[i], i == found.used - 1);
+    free(found.all);
+    return it;
+}
+
+/* iterates over the paths whose values start with prefix, in the same
+order as store_walk */
+store_iter* store_search_prefix(store *s, const char *prefix,
+                                size_t prefix_length)
+{
+    return search_part(s, ITER_PREFIX, prefix, prefix_length);
+}
+
+/* iterates over the paths whose values contain part, in the same
+order as store_walk */
+store_iter* store_search_substring(store *s, const char *part,
+                                   size_t part_length)
+{
+    return search_part(s, ITER_SUBSTRING, part, part_length);
+}
+
+/* returns the next path walked by it */
+Path* next_node(store_iter *it)
+{
+    Path *path;
+
+    while(it->n > 0) {
+        if(it->started && !advance(it))
+            return NULL;
+        it->started = TRUE;
+        path = it->stack[it->n - 1];
+        if(value_at(path, it->snap->version) != NULL)
+            return path;
+    }
+    return NULL;
+}
+
+/* returns the next path found by the search it, with the paths on its way
+on its stack */
+Path* next_found(store_iter *it)
+{
+    found_path *next;
+    int i;
+
+    if(it->next_result == it->num_results)
+        return NULL;
+    next = &it->results[it->next_result++];
+    it->n = 0;
+    for(i = 0; i < next->length; i++)
+        push(it, it->found[next->start + i]);
+    return it->stack[it->n - 1];
+}
+
+/* points path and value to the next path of the iteration it and to its value
+and returns TRUE, or returns FALSE when there are no more paths */
+int store_next(store_iter *it, const char **path, size_t *path_length,
+               const char **value, size_t *value_length)
+{
+    Path *next;
+    Value *v;
+    size_t length = it->prefix;
+    int i;
+
+    if(it->kind == ITER_LIST)
+        next = next_list(it);
+    else if(it->kind == ITER_SCAN)
+        next = next_scan(it);
+    else if(it->kind == ITER_WALK)
+        next = next_node(it);
+    else
+        next = next_found(it);
+    if(next == NULL)
+        return FALSE;
+
+    for(i = 0; i < it->n; i++)
+        length = add_name(it, length, it->stack[i]);
+    *path = it->path;
+    *path_length = length;
+    v = value_at(next, it->snap->version);
+    *value = v != NULL ? it->s->values->heap + v->offset : NULL;
+    *value_length = v != NULL ? v->length : 0;
+    return TRUE;
+}
+
+/* frees the iteration it */
+void store_iter_free(store_iter *it)
+{
+    store *s = it->s;
+
+    free(it->found);
+    free(it->results);
+    unpin(s, it->snap);
+    free(it->stack);
+    free(it->key);
+    free(it->pattern);
+    free(it->path);
+    free(it);
+    fit_budget(s);
+}
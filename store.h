@@ -0,0 +1,213 @@
+/*
+ * File: store.h
+ * Author: Sofia Pinho
+ * Description: The hierarchical storage system of proj2 as a library, so that
+ * it can be embedded and driven through direct calls instead of text commands.
+ * Paths and values are given as slices of chars that don't need to end in a
+ * '\0', paths are normalized like the paths of the commands of proj2, so
+ * "a//b/" is the same path as "/a/b", and "/" or "" stand for the root.
+ *
+ * Build: gcc -c -Wall -Wextra -ansi -pedantic store.c
+*/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stddef.h>
+
+/* results of the functions of the store */
+#define STORE_OK         0
+#define STORE_NOT_FOUND  1 /* the path isn't in the store */
+#define STORE_NO_DATA    2 /* the path is in the store but has no value */
+#define STORE_INVALID    3 /* the root can't hold a value or be moved */
+#define STORE_EXISTS     4 /* the path a path is moved to is in the store */
+
+/* a store of paths and values, an iteration over some of its paths and
+a transaction of changes to be applied to it at once */
+typedef struct store store;
+typedef struct store_iter store_iter;
+typedef struct store_txn store_txn;
+
+/* a function that gets the changes of the values of the paths a subscriber
+watches, with the path whose value changed, its old value and its new value,
+NULL if it had none or has none anymore, which must not modify the store */
+typedef void store_listener(void *subscriber,
+                            const char *path, size_t path_length,
+                            const char *old_value, size_t old_length,
+                            const char *new_value, size_t new_length);
+
+/* the number of paths below a path and the total size of their values, and,
+for the whole store, the memory used by the names of the paths, by the values
+and by the indexes of the paths and of the values, where clones that are
+shared count once and spilled paths don't count, without the room kept for
+more of them, so that they add up to what its budget limits, with its budget
+of memory and the number of directories looked up in memory, hits, or read
+back from the spill file, misses, and written to it, spills */
+typedef struct {
+    long subpaths, bytes;
+    long keys, values, index;
+    long budget, hits, misses, spills;
+} store_info;
+
+/* returns a new empty store */
+store* store_open();
+
+/* frees the store s and everything in it */
+void store_close(store *s);
+
+/* stores value at path, creating the path and the paths it is a subpath of
+that don't exist yet, returns STORE_INVALID if path is the root */
+int store_set(store *s, const char *path, size_t path_length,
+              const char *value, size_t value_length);
+
+/* points value and value_length to the value stored at path, returns
+STORE_NOT_FOUND or STORE_NO_DATA if it has none, the value is valid
+until the store is modified */
+int store_get(store *s, const char *path, size_t path_length,
+              const char **value, size_t *value_length);
+
+/* deletes path and all its subpaths, returns STORE_NOT_FOUND if it
+isn't in the store */
+int store_delete(store *s, const char *path, size_t path_length);
+
+/* moves path from, with all its subpaths, to path to, creating the paths to
+is a subpath of that don't exist yet, in time that depends on the length of the
+paths but not on the number of subpaths, returns STORE_NOT_FOUND if from isn't
+in the store, STORE_EXISTS if to is, and STORE_INVALID if either one is the
+root or if to is a subpath of from, a moved path comes after the other
+subpaths of its new directory in the order of store_walk */
+int store_move(store *s, const char *from, size_t from_length,
+               const char *to, size_t to_length);
+
+/* clones path from, with all its subpaths, to path to, creating the paths to
+is a subpath of that don't exist yet, the clone shares the subpaths and values
+of from until either one is changed, when only the directories on the way of
+the change are copied, returns the same as store_move */
+int store_clone(store *s, const char *from, size_t from_length,
+                const char *to, size_t to_length);
+
+/* deletes every path of the store s */
+void store_clear(store *s);
+
+/* returns a new empty transaction, whose changes are only kept until they
+are committed to a store */
+store_txn* store_begin();
+
+/* adds to the transaction t the change of storing value at path, returns
+STORE_INVALID if path is the root */
+int store_txn_set(store_txn *t, const char *path, size_t path_length,
+                  const char *value, size_t value_length);
+
+/* adds to the transaction t the deletion of path and all its subpaths,
+or of every path if path is the root */
+void store_txn_delete(store_txn *t, const char *path, size_t path_length);
+
+/* applies the changes of the transaction t to the store s as if they were
+made one after the other, but at once, so that no iteration sees only some of
+them, and frees t, the values set between two deletions are stored in the
+order of their paths, so that the names they share are looked up only once,
+and so the paths they create come in that order in store_walk, returns the
+number of deletions whose path wasn't in the store */
+int store_commit(store *s, store_txn *t);
+
+/* frees the transaction t without applying its changes */
+void store_abort(store_txn *t);
+
+/* returns 1 if path stands for the root and 0 otherwise */
+int store_is_root(const char *path, size_t length);
+
+/* fills info with the number of subpaths of path and the size of their
+values, and with the memory used by the store if path is the root, returns
+STORE_NOT_FOUND if it isn't in the store */
+int store_stats(store *s, const char *path, size_t path_length,
+                store_info *info);
+
+/* limits the memory the paths and values of the store s take to budget bytes,
+or lifts the limit if budget is 0, above it the subpaths of the paths looked
+up the longest ago are written to a temporary spill file, and read back
+whenever they're looked up or iterated over, since an iteration holds its
+paths nothing is spilled while one is in use */
+void store_set_budget(store *s, long budget);
+
+/* makes subscriber watch path and its subpaths, even if they aren't in the
+store yet, so that listener is called with every change of their values by
+store_set, store_delete, store_move, store_clone, store_clear and store_commit,
+as they're made, once for each subscriber however many of the paths above the
+changed one it watches, the watched paths are kept in a trie so that a change
+costs the same whatever the number of watched paths, with one step for each
+subscription to the changed path or to a path above it, and nothing if there
+are none, a deletion or a move calls listener for each path with a value that
+goes away or comes in, watching a path again only changes its listener */
+void store_watch(store *s, const char *path, size_t path_length,
+                 store_listener *listener, void *subscriber);
+
+/* makes subscriber stop watching path, returns STORE_NOT_FOUND if
+it doesn't watch it */
+int store_unwatch(store *s, const char *path, size_t path_length,
+                  void *subscriber);
+
+/* makes subscriber stop watching every path it watches, which costs as much
+as the paths it watches, whatever the number of the other watched paths */
+void store_unwatch_all(store *s, void *subscriber);
+
+/* the iterations return NULL if the path they start from isn't in the store,
+each one pins a snapshot of the store and sees it as it was when the iteration
+was made even if it's modified while the iteration is in use, the paths and
+values kept for a snapshot are freed when the last iteration that pins it is
+freed, so iterations must be freed before their store is closed */
+
+/* iterates, in alphabetical order, over the paths that are direct subpaths
+of dir, starting at the first one that doesn't come before from if its length
+isn't 0, which must be a subpath of dir */
+store_iter* store_list(store *s, const char *dir, size_t dir_length,
+                       const char *from, size_t from_length);
+
+/* iterates, in alphabetical order, over the paths with values below dir that
+are at most depth directories below it (0 for no limit) and match the glob
+pattern, where '*' matches any sequence of chars and '?' a single one in each
+directory, if the length of pattern isn't 0, returns NULL if depth is negative */
+store_iter* store_scan(store *s, const char *dir, size_t dir_length,
+                       int depth, const char *pattern, size_t pattern_length);
+
+/* iterates over the paths with values in the order they were created, with
+subpaths right after the path they are a subpath of, starting at from unless
+it is the root */
+store_iter* store_walk(store *s, const char *from, size_t from_length);
+
+/* iterates over the paths that hold value, in the same order as store_walk,
+every value keeps a list of the paths that hold it, so that only those are
+gone through, with the paths above them */
+store_iter* store_search(store *s, const char *value, size_t value_length);
+
+/* iterate over the paths whose values start with prefix, or contain part, in
+the same order as store_walk, the values are looked up in an index built the
+first time one of them is called, and kept up to date from then on, where the
+values are sorted, for prefixes, and listed under every trigram, three chars,
+they contain, for parts, and the paths through the lists of the paths that
+hold each value found, the values written to the spill file leave their grams
+in a set, so that the spilled paths are only read back when some of them may
+match, no path matches an empty prefix or part */
+store_iter* store_search_prefix(store *s, const char *prefix,
+                                size_t prefix_length);
+store_iter* store_search_substring(store *s, const char *part,
+                                   size_t part_length);
+
+/* points path and value to the next path of the iteration it and to its value
+(NULL if it has none) and returns 1, or returns 0 when there are no more paths,
+they are valid until the next call or until the store is modified */
+int store_next(store_iter *it, const char **path, size_t *path_length,
+               const char **value, size_t *value_length);
+
+/* frees the iteration it */
+void store_iter_free(store_iter *it);
+
+/* counters of the events that dominate the cost of the store, compiled
+in only with -DPROFILE so that it costs nothing otherwise */
+#ifdef PROFILE
+enum {EV_STRINGCMP, EV_ALLOC, EV_ROTATION, NUM_EVENTS};
+
+extern const char *event_names[NUM_EVENTS];
+extern unsigned long profile_events[NUM_EVENTS];
+#endif
+
+#endif